@@ -0,0 +1,65 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_CONTROL_ALLOCATION_COUNTER_H__
+#define VIGIR_STEP_CONTROL_ALLOCATION_COUNTER_H__
+
+#include <cstddef>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Counts heap allocations per thread for testing purposes. Counting is only available
+ * when the allocation hook (src/allocation_hook.cpp) has been linked into the executable, which
+ * can be enabled by the ALLOCATION_CHECK cmake option.
+ */
+class AllocationCounter
+{
+public:
+  /**
+   * @brief Returns if the allocation hook is available.
+   * @return True if allocations are being counted
+   */
+  static bool isEnabled();
+
+  /**
+   * @brief Returns number of heap allocations done by the calling thread so far.
+   * @return Number of allocations
+   */
+  static size_t count();
+
+  // called by the allocation hook
+  static void enable();
+  static void countAllocation();
+};
+}
+
+#endif
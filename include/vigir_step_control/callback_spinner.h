@@ -0,0 +1,95 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#ifndef VIGIR_STEP_CONTROL_CALLBACK_SPINNER_H__
+#define VIGIR_STEP_CONTROL_CALLBACK_SPINNER_H__
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Serves a dedicated callback queue by a pool of threads running at a given scheduling priority.
+ * In contrast to ros::AsyncSpinner the priority of the threads can be chosen, so callbacks of one group
+ * (e.g. the control loop) are not delayed by expensive callbacks of other groups.
+ */
+class CallbackSpinner
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<CallbackSpinner> Ptr;
+  typedef boost::shared_ptr<const CallbackSpinner> ConstPtr;
+
+  /**
+   * @brief CallbackSpinner
+   * @param name Name of callback group used for logging
+   * @param threads Number of threads serving the queue
+   * @param priority Scheduling priority of the threads (see setThreadPriority)
+   */
+  CallbackSpinner(const std::string& name, unsigned int threads, int priority);
+  virtual ~CallbackSpinner();
+
+  /**
+   * @brief Returns the queue which must be assigned to node handles of this group.
+   * @return Callback queue
+   */
+  ros::CallbackQueue* getCallbackQueue() { return &queue_; }
+
+  const std::string& getName() const { return name_; }
+
+  /**
+   * @brief Starts the threads. Does nothing if already running.
+   */
+  void start();
+
+  /**
+   * @brief Stops and joins all threads. Callbacks still running are completed before.
+   */
+  void stop();
+
+protected:
+  void spin();
+
+  std::string name_;
+  unsigned int threads_;
+  int priority_;
+
+  ros::CallbackQueue queue_;
+
+  boost::atomic<bool> running_;
+  std::vector<boost::shared_ptr<boost::thread>> spinner_threads_;
+};
+}
+
+#endif
@@ -0,0 +1,151 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_CONTROL_COMPACT_CODEC_H__
+#define VIGIR_STEP_CONTROL_COMPACT_CODEC_H__
+
+#include <ros/ros.h>
+
+#include <vigir_footstep_planning_msgs/footstep_planning_msgs.h>
+
+
+
+namespace vigir_step_control
+{
+using namespace vigir_footstep_planning;
+
+/**
+ * @brief Compact wire format of step plans for constrained links. Poses and step parameters are quantized
+ * and delta-encoded against the previous step, while all integers are written as (zigzag) varints. As
+ * quantized values are accumulated as integers, decoding does not drift along the plan. The step plan must
+ * contain a continuous sequence of steps; step indices are restored from the first step index.
+ * Decoding is deterministic, so steps overlapping with previously decoded step plans match exactly.
+ */
+class CompactStepPlanCodec
+{
+public:
+  /**
+   * @brief Quantization of encoded values. Encoder and decoder must use the same resolution.
+   */
+  struct Resolution
+  {
+    Resolution(double position = 1e-4, double orientation = 1e-6, double parameter = 1e-4)
+      : position(position)
+      , orientation(orientation)
+      , parameter(parameter)
+    {}
+
+    // resolution of foot positions [m]
+    double position;
+
+    // resolution of quaternion components
+    double orientation;
+
+    // resolution of step parameters (step_duration, sway_duration, swing_height, cost, risk)
+    double parameter;
+  };
+
+  CompactStepPlanCodec(const Resolution& resolution = Resolution());
+
+  /**
+   * @brief Encodes step plan. Memory already owned by the buffer is reused.
+   * @param step_plan Step plan
+   * @param buffer [out] Encoded step plan
+   * @return False if step plan is not continuous
+   */
+  bool encode(const msgs::StepPlan& step_plan, std::vector<uint8_t>& buffer) const;
+
+  /**
+   * @brief Decodes step plan. Memory already owned by the step plan is reused.
+   * @param buffer Encoded step plan
+   * @param step_plan [out] Step plan
+   * @return False if buffer is corrupted
+   */
+  bool decode(const std::vector<uint8_t>& buffer, msgs::StepPlan& step_plan) const;
+
+protected:
+  Resolution resolution_;
+};
+
+/**
+ * @brief Compact wire format of execution feedback. Only fields which have changed since the previous message
+ * are sent as varint encoded deltas. A full key frame is sent periodically, so a decoder recovers from lost
+ * messages. Encoder and decoder are stateful; each instance serves a single stream.
+ */
+class CompactFeedbackEncoder
+{
+public:
+  /**
+   * @brief CompactFeedbackEncoder
+   * @param key_frame_interval Each key_frame_interval-th message is sent as key frame
+   */
+  CompactFeedbackEncoder(unsigned int key_frame_interval = 10u);
+
+  /**
+   * @brief Encodes feedback with respect to the previously encoded feedback. Memory already owned by
+   * the buffer is reused.
+   * @param feedback Feedback
+   * @param buffer [out] Encoded feedback
+   */
+  void encode(const msgs::ExecuteStepPlanFeedback& feedback, std::vector<uint8_t>& buffer);
+
+  /**
+   * @brief Forces the next message to be sent as key frame (e.g. when a new subscriber has connected).
+   */
+  void reset();
+
+protected:
+  unsigned int key_frame_interval_;
+  unsigned int messages_since_key_frame_;
+  uint8_t seq_;
+  bool has_previous_;
+  msgs::ExecuteStepPlanFeedback previous_;
+};
+
+class CompactFeedbackDecoder
+{
+public:
+  CompactFeedbackDecoder();
+
+  /**
+   * @brief Decodes feedback. After a lost message, delta frames are dropped until the next key frame.
+   * @param buffer Encoded feedback
+   * @param feedback [out] Decoded feedback
+   * @return False if the feedback could not be restored
+   */
+  bool decode(const std::vector<uint8_t>& buffer, msgs::ExecuteStepPlanFeedback& feedback);
+
+protected:
+  bool synchronized_;
+  uint8_t seq_;
+  msgs::ExecuteStepPlanFeedback current_;
+};
+}
+
+#endif
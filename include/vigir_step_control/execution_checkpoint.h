@@ -0,0 +1,145 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_CONTROL_EXECUTION_CHECKPOINT_H__
+#define VIGIR_STEP_CONTROL_EXECUTION_CHECKPOINT_H__
+
+#include <ros/ros.h>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include <vigir_step_control/step_controller_plugin.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Persists the execution state (step queue, indices and feedback) into a memory-mapped file, so
+ * a respawned node can continue a running execution immediately. The file contains two slots which are
+ * written alternately; a slot is only considered valid when its checksum matches, so a crash while
+ * writing never corrupts the last valid checkpoint. Checkpoints are written by a low priority thread
+ * from lock-free snapshots. Checkpoints are invalidated as soon as no execution is in progress anymore.
+ */
+class ExecutionCheckpoint
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<ExecutionCheckpoint> Ptr;
+  typedef boost::shared_ptr<const ExecutionCheckpoint> ConstPtr;
+
+  typedef boost::function<StepControllerSnapshot::ConstPtr()> SnapshotCallback;
+
+  /**
+   * @brief ExecutionCheckpoint
+   * @param file_name Path of checkpoint file; will be created if needed
+   * @param max_size Maximal size [byte] of a single checkpoint
+   */
+  ExecutionCheckpoint(const std::string& file_name, size_t max_size = 1048576u);
+  virtual ~ExecutionCheckpoint();
+
+  /**
+   * @brief Checks if checkpoint file could be mapped into memory.
+   * @return True if checkpoint file is usable
+   */
+  bool isOpen() const;
+
+  /**
+   * @brief Reads latest valid checkpoint.
+   * @param checkpoint [out] Restored execution state
+   * @param max_age Checkpoints older than max_age are ignored
+   * @return True if a valid checkpoint has been found
+   */
+  bool read(StepControllerSnapshot& checkpoint, const ros::WallDuration& max_age) const;
+
+  /**
+   * @brief Writes given execution state into the currently inactive slot.
+   * @param snapshot Execution state
+   * @return False if execution state exceeds maximal checkpoint size
+   */
+  bool write(const StepControllerSnapshot& snapshot);
+
+  /**
+   * @brief Starts periodically writing checkpoints in background.
+   * @param get_snapshot Callback returning latest snapshot; must not acquire the controller lock
+   * @param rate Checkpoint rate [Hz]
+   */
+  void start(SnapshotCallback get_snapshot, double rate);
+
+  /**
+   * @brief Stops writing checkpoints in background.
+   */
+  void stop();
+
+  /**
+   * @brief Invalidates all stored checkpoints, so no execution is restored after a restart. Must not be
+   * called while checkpoints are written in background.
+   */
+  void clear();
+
+protected:
+  struct SlotHeader
+  {
+    uint32_t magic;
+    uint32_t format_version;
+    uint64_t sequence;
+    int64_t stamp;
+    uint32_t payload_size;
+    uint32_t checksum;
+  };
+
+  void run();
+
+  SlotHeader* slotHeader(size_t slot) const;
+  uint8_t* slotPayload(size_t slot) const;
+
+  /**
+   * @brief Returns index of latest valid slot.
+   * @return Slot index; -1 if no slot is valid
+   */
+  int latestValidSlot() const;
+
+  std::string file_name_;
+  size_t slot_size_;
+
+  int fd_;
+  uint8_t* data_;
+
+  uint64_t sequence_;
+  size_t next_slot_;
+
+  SnapshotCallback get_snapshot_;
+  ros::WallDuration period_;
+
+  boost::thread thread_;
+};
+}
+
+#endif
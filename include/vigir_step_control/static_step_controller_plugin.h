@@ -0,0 +1,141 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef STATIC_STEP_CONTROLLER_PLUGIN_H__
+#define STATIC_STEP_CONTROLLER_PLUGIN_H__
+
+#include <ros/ros.h>
+
+#include <vigir_step_control/step_controller_plugin.h>
+
+
+
+namespace vigir_step_control
+{
+using namespace vigir_footstep_planning_msgs;
+
+/**
+ * @brief CRTP base for step controller plugins which allows to run the complete update cycle
+ * without any virtual dispatch. Derived classes have to pass themselves as template parameter:
+ *
+ *   class MyPlugin : public StaticStepControllerPlugin<MyPlugin> { ... };
+ *
+ * As StaticStepControllerPlugin is a StepControllerPlugin itself, the derived plugin can still be
+ * exported and loaded through pluginlib (PLUGINLIB_EXPORT_CLASS(MyPlugin, StepControllerPlugin)).
+ * Alternatively, it can be compiled directly into a StaticStepController.
+ */
+template<typename Derived>
+class StaticStepControllerPlugin
+  : public StepControllerPlugin
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<StaticStepControllerPlugin> Ptr;
+  typedef boost::shared_ptr<const StaticStepControllerPlugin> ConstPtr;
+
+  StaticStepControllerPlugin()
+    : StepControllerPlugin()
+  {}
+
+  virtual ~StaticStepControllerPlugin() {}
+
+  /**
+   * @brief Default behavior of StepControllerPlugin::process(...), but calls Derived::executeStep(...)
+   * directly.
+   */
+  void process(const ros::TimerEvent& /*event*/) override
+  {
+    if (getState() != ACTIVE)
+      return;
+
+    if (isAsyncExecutionEnabled())
+      spoolStepsAsync();
+    else
+      spoolSteps([this](const msgs::Step& step) { return derived().Derived::executeStep(step); });
+  }
+
+  /**
+   * @brief Runs a complete update cycle (preProcess, process, postProcess) using static dispatch.
+   * @param event Timer event of current cycle
+   */
+  void update(const ros::TimerEvent& event)
+  {
+    derived().Derived::preProcess(event);
+    derived().Derived::process(event);
+    derived().Derived::postProcess(event);
+  }
+
+protected:
+  inline Derived& derived() { return static_cast<Derived&>(*this); }
+  inline const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+/**
+ * @brief Minimal step controller for tight embedded loops which owns the robot specific plugin
+ * directly. All calls into the plugin are statically dispatched. In contrast to StepController,
+ * it doesn't provide any ROS interface and locking; the owner is responsible for calling
+ * executeStepPlan(...) and update(...) from the same thread.
+ */
+template<typename PluginT>
+class StaticStepController
+{
+public:
+  StaticStepController() {}
+  virtual ~StaticStepController() {}
+
+  /**
+   * @brief Instruct the controller to execute the given step plan. If execution is already in progress,
+   * the step plan will be merged into current execution queue. An empty step plan triggers a soft stop.
+   * @param Step plan to be executed
+   */
+  void executeStepPlan(const msgs::StepPlan& step_plan)
+  {
+    if (step_plan.steps.empty())
+      plugin_.PluginT::stop();
+    else
+      plugin_.PluginT::updateStepPlan(step_plan);
+  }
+
+  /**
+   * @brief Main update loop to be called in regular intervals.
+   */
+  void update(const ros::TimerEvent& event = ros::TimerEvent())
+  {
+    plugin_.update(event);
+  }
+
+  inline PluginT& plugin() { return plugin_; }
+  inline const PluginT& plugin() const { return plugin_; }
+
+protected:
+  PluginT plugin_;
+};
+}
+
+#endif
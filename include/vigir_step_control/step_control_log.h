@@ -0,0 +1,257 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_CONTROL_LOG_H__
+#define VIGIR_STEP_CONTROL_LOG_H__
+
+#include <ros/ros.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/thread.hpp>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Static description and rate limit state of a single log statement. Each log statement
+ * owns exactly one instance (see STEP_CONTROL_LOG).
+ */
+struct LogSite
+{
+  LogSite(ros::console::levels::Level level, double min_period)
+    : level(level)
+    , min_period(static_cast<int64_t>(min_period * 1e9))
+    , next_allowed(0)
+    , suppressed(0u)
+  {}
+
+  const ros::console::levels::Level level;
+
+  // minimal time between two emitted events [ns]
+  const int64_t min_period;
+
+  // rate limit state
+  boost::atomic<int64_t> next_allowed;
+  boost::atomic<unsigned int> suppressed;
+};
+
+/**
+ * @brief Single argument of a log event. Only scalar values are supported; strings
+ * must have static storage duration (e.g. string literals).
+ */
+union LogArg
+{
+  int64_t i;
+  uint64_t u;
+  double d;
+  const void* p;
+};
+
+template<typename T> inline typename std::enable_if<std::is_floating_point<T>::value>::type packLogArg(LogArg& arg, T value) { arg.d = value; }
+template<typename T> inline typename std::enable_if<std::is_pointer<T>::value>::type packLogArg(LogArg& arg, T value) { arg.p = value; }
+template<typename T> inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type packLogArg(LogArg& arg, T value) { arg.i = value; }
+template<typename T> inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type packLogArg(LogArg& arg, T value) { arg.u = value; }
+template<typename T> inline typename std::enable_if<std::is_enum<T>::value>::type packLogArg(LogArg& arg, T value) { arg.i = static_cast<int64_t>(value); }
+
+template<typename T> inline typename std::enable_if<std::is_floating_point<T>::value, T>::type unpackLogArg(const LogArg& arg) { return static_cast<T>(arg.d); }
+template<typename T> inline typename std::enable_if<std::is_pointer<T>::value, T>::type unpackLogArg(const LogArg& arg) { return static_cast<T>(const_cast<void*>(arg.p)); }
+template<typename T> inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, T>::type unpackLogArg(const LogArg& arg) { return static_cast<T>(arg.i); }
+template<typename T> inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, T>::type unpackLogArg(const LogArg& arg) { return static_cast<T>(arg.u); }
+template<typename T> inline typename std::enable_if<std::is_enum<T>::value, T>::type unpackLogArg(const LogArg& arg) { return static_cast<T>(arg.i); }
+
+/**
+ * @brief Unformatted log event as stored in the log ring.
+ */
+struct LogEvent
+{
+  static const size_t MAX_ARGS = 6u;
+
+  typedef int (*Formatter)(const LogEvent& event, char* buffer, size_t size);
+
+  const LogSite* site;
+  const char* format;
+  Formatter formatter;
+  unsigned int suppressed;
+  LogArg args[MAX_ARGS];
+};
+
+namespace detail
+{
+template<size_t... I> struct LogIndices {};
+template<size_t N, size_t... I> struct MakeLogIndices : MakeLogIndices<N-1, N-1, I...> {};
+template<size_t... I> struct MakeLogIndices<0, I...> { typedef LogIndices<I...> type; };
+
+template<typename... Args>
+struct LogFormatter
+{
+  static int format(const LogEvent& event, char* buffer, size_t size)
+  {
+    return formatImpl(event, buffer, size, typename MakeLogIndices<sizeof...(Args)>::type());
+  }
+
+  template<size_t... I>
+  static int formatImpl(const LogEvent& event, char* buffer, size_t size, LogIndices<I...>)
+  {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+    return snprintf(buffer, size, event.format, unpackLogArg<Args>(event.args[I])...);
+#pragma GCC diagnostic pop
+  }
+};
+
+inline void packLogArgs(LogArg* /*args*/) {}
+
+template<typename T, typename... Args>
+inline void packLogArgs(LogArg* args, T value, Args... rest)
+{
+  static_assert(std::is_scalar<T>::value, "Only scalar values can be logged. Strings must be passed as static 'const char*'.");
+  packLogArg(*args, value);
+  packLogArgs(args+1, rest...);
+}
+}
+
+/**
+ * @brief Non-blocking logger for the control loop. Log statements only copy their arguments into a
+ * lock-free ring; formatting and output via rosconsole is deferred to a low priority background thread.
+ * Events are dropped (and counted) when the ring is full, so bursts can never stall the caller.
+ */
+class LogRing
+{
+public:
+  static const size_t CAPACITY = 1024u;
+
+  static LogRing& instance();
+
+  ~LogRing();
+
+  /**
+   * @brief Enqueues log event. This method is lock-free and does not allocate any memory.
+   * @param site Log site
+   * @param format printf format string; must be a string literal
+   * @param args Format arguments (at most LogEvent::MAX_ARGS)
+   */
+  template<typename... Args>
+  void log(LogSite& site, const char* format, Args... args)
+  {
+    static_assert(sizeof...(Args) <= LogEvent::MAX_ARGS, "Too many log arguments.");
+
+    // apply rate limit of site
+    if (site.min_period > 0)
+    {
+      int64_t now = ros::WallTime::now().toNSec();
+      int64_t next_allowed = site.next_allowed.load(boost::memory_order_relaxed);
+      if (now < next_allowed || !site.next_allowed.compare_exchange_strong(next_allowed, now + site.min_period, boost::memory_order_relaxed))
+      {
+        site.suppressed.fetch_add(1u, boost::memory_order_relaxed);
+        return;
+      }
+    }
+
+    LogEvent event;
+    event.site = &site;
+    event.format = format;
+    event.formatter = &detail::LogFormatter<Args...>::format;
+    event.suppressed = site.min_period > 0 ? site.suppressed.exchange(0u, boost::memory_order_relaxed) : 0u;
+    detail::packLogArgs(event.args, args...);
+
+    if (!ring_.bounded_push(event))
+      dropped_.fetch_add(1u, boost::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns number of events dropped due to full ring.
+   * @return Number of dropped events
+   */
+  size_t getDroppedCount() const { return dropped_.load(boost::memory_order_relaxed); }
+
+  /**
+   * @brief Formats and outputs all enqueued events immediately. Events refer to code and string
+   * literals of the logging library, so the ring must be flushed before a plugin library is unloaded.
+   * This method blocks and must not be called in the control loop.
+   * @return Number of processed events
+   */
+  size_t flush();
+
+  /**
+   * @brief Keeps the given object (e.g. a replaced plugin) alive until all events enqueued before have been
+   * output by the background thread, which releases it afterwards. This way the library of the object stays
+   * loaded as long as pending events refer to it. This method does not wait for the ring to be drained.
+   * Note that the object may be destroyed by the background thread, so its destructor must not log via LogRing.
+   * @param object Object to be released
+   */
+  void releaseAfterFlush(boost::shared_ptr<void> object);
+
+protected:
+  LogRing();
+
+  void run();
+
+  boost::lockfree::queue<LogEvent, boost::lockfree::capacity<CAPACITY>> ring_;
+  boost::atomic<size_t> dropped_;
+  size_t reported_dropped_;
+  boost::mutex flush_mutex_;
+
+  // objects to be released after the next flush; must be accessed while holding retired_mutex_
+  std::vector<boost::shared_ptr<void>> retired_;
+  boost::mutex retired_mutex_;
+
+  boost::atomic<bool> running_;
+  boost::thread thread_;
+};
+}
+
+/**
+ * @brief Logs printf-style message via LogRing. Each statement emits at most one event per min_period [s];
+ * suppressed events are counted and reported with the next emitted one.
+ */
+#define STEP_CONTROL_LOG(level, min_period, ...) \
+  do { \
+    static vigir_step_control::LogSite __step_control_log_site(level, min_period); \
+    vigir_step_control::LogRing::instance().log(__step_control_log_site, __VA_ARGS__); \
+  } while (false)
+
+#define STEP_CONTROL_DEBUG(...) STEP_CONTROL_LOG(::ros::console::levels::Debug, 0.0, __VA_ARGS__)
+#define STEP_CONTROL_INFO(...) STEP_CONTROL_LOG(::ros::console::levels::Info, 0.0, __VA_ARGS__)
+#define STEP_CONTROL_WARN(...) STEP_CONTROL_LOG(::ros::console::levels::Warn, 0.0, __VA_ARGS__)
+#define STEP_CONTROL_ERROR(...) STEP_CONTROL_LOG(::ros::console::levels::Error, 0.0, __VA_ARGS__)
+
+#define STEP_CONTROL_DEBUG_THROTTLE(period, ...) STEP_CONTROL_LOG(::ros::console::levels::Debug, period, __VA_ARGS__)
+#define STEP_CONTROL_INFO_THROTTLE(period, ...) STEP_CONTROL_LOG(::ros::console::levels::Info, period, __VA_ARGS__)
+#define STEP_CONTROL_WARN_THROTTLE(period, ...) STEP_CONTROL_LOG(::ros::console::levels::Warn, period, __VA_ARGS__)
+#define STEP_CONTROL_ERROR_THROTTLE(period, ...) STEP_CONTROL_LOG(::ros::console::levels::Error, period, __VA_ARGS__)
+
+#endif
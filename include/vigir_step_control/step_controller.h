@@ -29,7 +29,15 @@
 #ifndef STEP_CONTROLLER_H__
 #define STEP_CONTROLLER_H__
 
+#include <deque>
+
+#include <boost/thread/condition_variable.hpp>
+
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
+
+#include <std_msgs/Empty.h>
+#include <geometry_msgs/Transform.h>
 
 #include <actionlib/server/simple_action_server.h>
 
@@ -38,7 +46,17 @@
 #include <vigir_footstep_planning_msgs/footstep_planning_msgs.h>
 #include <vigir_footstep_planning_plugins/plugins/step_plan_msg_plugin.h>
 
+#include <vigir_step_control/Backpressure.h>
+#include <vigir_step_control/CompactFeedback.h>
+#include <vigir_step_control/CompactStepPlan.h>
+#include <vigir_step_control/StepPlanChunk.h>
+#include <vigir_step_control/callback_spinner.h>
+#include <vigir_step_control/compact_codec.h>
+#include <vigir_step_control/execution_checkpoint.h>
+#include <vigir_step_control/step_controller_diagnostics.h>
 #include <vigir_step_control/step_controller_plugin.h>
+#include <vigir_step_control/step_plan_file.h>
+#include <vigir_step_control/step_queue_introspection.h>
 
 
 
@@ -65,84 +83,411 @@ public:
   virtual ~StepController();
 
   /**
-   * @brief Loads plugin with specific name to be used by the controller. The name should be configured
-   * in the plugin config file and loaded to the rosparam server. The call can only succeed when currentl
-   * no exection is runnning.
+   * @brief Loads plugin with specific name. The name should be configured in the plugin config file and
+   * loaded to the rosparam server. This call blocks until the plugin has been loaded and initialized,
+   * but does not acquire any lock of the controller. Hence, it can be safely called in background.
    * @param plugin_name Name of plugin
+   * @param plugin Outgoing variable for loaded plugin
+   * @return True if plugin could be loaded
    */
   template<typename T>
-  void loadPlugin(const std::string& plugin_name, boost::shared_ptr<T>& plugin)
+  bool loadPlugin(const std::string& plugin_name, boost::shared_ptr<T>& plugin) const
   {
-    boost::unique_lock<boost::shared_mutex> lock(controller_mutex_);
-
-    if (step_controller_plugin_ && step_controller_plugin_->getState() == ACTIVE)
-    {
-      ROS_ERROR("[StepController] Cannot replace plugin due to active footstep execution!");
-      return;
-    }
-
     if (!vigir_pluginlib::PluginManager::addPluginByName(plugin_name))
     {
       ROS_ERROR("[StepController] Could not load plugin '%s'!", plugin_name.c_str());
-      return;
+      return false;
     }
-    else if (!vigir_pluginlib::PluginManager::getPlugin(plugin))
+    else if (!vigir_pluginlib::PluginManager::getPlugin(plugin, plugin_name))
     {
       ROS_ERROR("[StepController] Could not obtain plugin '%s' from plugin manager!", plugin_name.c_str());
-      return;
+      return false;
     }
     else
       ROS_INFO("[StepController] Loaded plugin '%s'.", plugin_name.c_str());
+
+    return true;
   }
 
   /**
    * @brief Instruct the controller to execute the given step plan. If execution is already in progress,
-   * the step plan will be merged into current execution queue.
+   * the step plan will be merged into current execution queue. A step plan which cannot be merged yet due to
+   * the merge rate budget is merged by the next update cycle possible, unless it is superseded by a newer one
+   * in the meantime. Empty step plans (soft stop) are never deferred.
    * @param Step plan to be executed
    */
   void executeStepPlan(const msgs::StepPlan& step_plan);
+  void executeStepPlan(const msgs::StepPlanConstPtr& step_plan);
+
+  /**
+   * @brief Instruct the controller to execute a step plan which is streamed in chunks. The first chunk
+   * (seq = 0) is handled like a regular step plan, so execution begins immediately when it starts with
+   * step index 0. All following chunks of the same plan extend the execution queue. Chunks arriving
+   * out of order are buffered until all predecessors have been received, even if they precede the first
+   * chunk of their plan. A stream which doesn't receive any chunk within stream_timeout is completed
+   * with the steps received so far.
+   * @param chunk Chunk of step plan
+   */
+  void executeStepPlanChunk(const StepPlanChunk& chunk);
+
+  /**
+   * @brief Instruct the controller to execute a step plan stored in a step plan file (see StepPlanFile). The file
+   * is mapped into memory and paged into the execution queue while execution progresses, so only a window of
+   * plan_file_lookahead steps ahead of the walking engine is enqueued at any time. Hence, costs of starting the
+   * execution do not depend on the plan length. Any step plan or chunk received afterwards terminates paging.
+   * @param file_name Path of step plan file
+   * @return True if execution of the file has been started
+   */
+  bool executeStepPlanFile(const std::string& file_name);
+
+  /**
+   * @brief Stops execution immediately without waiting for the controller lock or the next update cycle.
+   * The stop is forwarded to the walking engine by StepControllerPlugin::emergencyStop() right away, while
+   * the next update cycle resets the plugin and aborts the active goal. May be called by any thread.
+   */
+  void emergencyStop();
+
+  /**
+   * @brief Corrects the poses of all changeable steps, e.g. when localization has corrected odometry drift.
+   * The correction is applied lazily, so step plan updates may still be provided in the uncorrected frame.
+   * @param correction Transformation applied to the step poses
+   */
+  void applyDriftCorrection(const tf::Transform& correction);
 
   /**
    * @brief Main update loop to be called in regular intervals.
    */
   void update(const ros::TimerEvent& event = ros::TimerEvent());
 
+  /**
+   * @brief Returns latest snapshot of execution state without acquiring the controller lock. Snapshots are
+   * only available when introspection or checkpointing has been enabled. Must not be called by the control thread
+   * as the queue content is copied by the calling thread (see StepControllerPlugin::getSnapshot()).
+   * @return Latest snapshot; empty pointer if not available
+   */
+  StepControllerSnapshot::ConstPtr getSnapshot() const;
+
+  /**
+   * @brief Returns the number of invariant violations detected so far. Invariants are only checked
+   * when check_invariants has been enabled.
+   * @return Number of invariant violations
+   */
+  size_t getInvariantViolations() const;
+
+  /**
+   * @brief Returns the number of heap allocations detected in steady state cycles so far. Allocations
+   * are only counted when check_allocations has been enabled. Steady state cycles are only allocation free
+   * when feedback_on_change_only is enabled (default in this mode), as publishing feedback serializes it.
+   * @return Number of steady state allocations
+   */
+  size_t getSteadyStateAllocations() const;
+
+  /**
+   * @brief Returns time needed from construction of the controller until it was ready to walk.
+   * @return Startup time
+   */
+  const ros::WallDuration& getStartupTime() const { return startup_time_; }
+
 protected:
   /**
-   * @brief Publishes feedback messages of current state of execution.
+   * @brief Applies the current controller configuration to a (newly loaded) step controller plugin.
+   * @param plugin Plugin to be configured
+   */
+  void configureStepControllerPlugin(StepControllerPlugin::Ptr plugin);
+
+  /**
+   * @brief Loads step controller plugin and schedules it for replacing the current plugin.
+   * This method is intended to run in background.
+   * @param plugin_name Name of plugin
+   */
+  void loadStepControllerPluginAsync(const std::string& plugin_name);
+
+  /**
+   * @brief Loads and initializes the given step controller plugins, so that a later switch to one of them
+   * neither pays for opening its library nor for its initialization. This method is intended to run in background.
+   * @param plugin_names Names of plugins
+   */
+  void preloadStepControllerPlugins(const std::vector<std::string>& plugin_names);
+
+  /**
+   * @brief Main loop of the plugin loader thread. Waits for queued load requests and serves them
+   * one after another until shutdown.
+   */
+  void processPluginLoadRequests();
+
+  /**
+   * @brief Replaces the current step controller plugin by a pending one (if available). The new plugin
+   * takes over the complete execution state (step queue, indices and feedback) of the previous plugin.
+   * Must be called at cycle boundaries while holding the controller lock.
+   */
+  void swapStepControllerPlugin();
+
+  /**
+   * @brief Resets the plugin and aborts the active goal after an emergency stop has been requested.
+   * Must be called while holding the controller lock.
    */
-  void publishFeedback() const;
+  void completeEmergencyStop();
+
+  /**
+   * @brief Merges the pending step plan if the merge rate budget permits. Step plans exceeding the
+   * queue capacity are rejected. Must be called while holding the controller lock.
+   */
+  void mergePendingStepPlan();
+
+  /**
+   * @brief Merges all consecutive chunks of the current stream received so far as long as the merge rate
+   * budget permits. Chunks exceeding the queue capacity are rejected and abort the stream. Must be called
+   * while holding the controller lock.
+   */
+  void mergePendingChunks();
+
+  /**
+   * @brief Drops all chunks of the current stream which have not been merged yet and reports them to
+   * diagnostics. Must be called while holding the controller lock.
+   */
+  void dropPendingChunks();
+
+  /**
+   * @brief Checks if merging the given step plan would exceed max_queue_size. Must be called while holding the controller lock.
+   * @param step_plan Step plan to be merged or appended
+   * @param queue_size [out] Resulting queue size
+   * @return True if the resulting queue size exceeds max_queue_size
+   */
+  bool exceedsMaxQueueSize(const msgs::StepPlan& step_plan, int& queue_size) const;
+
+  /**
+   * @brief Drops the pending step plan as it has been superseded by a newer request.
+   */
+  void discardPendingStepPlan();
+
+  /**
+   * @brief Enqueues further steps of the step plan file being executed as soon as they come within
+   * plan_file_lookahead steps of the walking engine. Must be called while holding the controller lock.
+   */
+  void pageInStepPlanFile();
+
+  /**
+   * @brief Terminates paging of the current step plan file. Must be called while holding the controller lock.
+   */
+  void closeStepPlanFile();
+
+  /**
+   * @brief Completes the current stream if no further chunk has been received within stream_timeout and
+   * drops outdated chunks of streams which have not been started. Must be called while holding the controller lock.
+   */
+  void checkStreamTimeout();
+
+  /**
+   * @brief Schedules an additional update cycle at the next send deadline of the timing scheduler,
+   * so that steps are sent in time independent of the update rate.
+   */
+  void scheduleSendDeadline();
+
+  /**
+   * @brief Publishes feedback messages of current state of execution. If feedback_on_change_only is enabled,
+   * feedback is only published when it has been changed since the last call; otherwise it is published
+   * in each cycle.
+   */
+  void publishFeedback();
+
+  /**
+   * @brief Publishes the backpressure signal when it has been changed since the last call.
+   */
+  void publishBackpressure();
+
+  /**
+   * @brief Publishes the predicted execution timeline when the step queue or the execution progress
+   * has been changed since the last call. Nothing is done as long as nobody is subscribed.
+   */
+  void publishExecutionTimeline();
 
   vigir_footstep_planning::StepPlanMsgPlugin::Ptr step_plan_msg_plugin_;
   StepControllerPlugin::Ptr step_controller_plugin_;
 
-  // mutex to ensure thread safeness
+  // owner lock of the execution state; held by the update cycle and all step plan ingestion callbacks
+  // (lock level 1, see StepControllerPlugin)
   boost::shared_mutex controller_mutex_;
 
+  // reserved memory of step queue
+  int queue_capacity_;
+  bool queue_fixed_capacity_;
+
+  // asynchronous step execution
+  bool async_execution_;
+  double async_execution_timeout_;
+  int max_steps_in_flight_;
+
+  // tolerance for detecting steps modified by step plan updates
+  StepQueue::Tolerance replan_tolerance_;
+
+  // timing scheduler sending steps just-in-time
+  bool deadline_scheduling_;
+  double deadline_safety_margin_;
+  ros::Time scheduled_deadline_;
+
+  // state of streamed step plan
+  bool streaming_;
+  unsigned int stream_plan_id_;
+  unsigned int stream_next_seq_;
+  std::map<unsigned int, StepPlanChunk> pending_chunks_;
+  ros::WallTime stream_last_chunk_time_;
+  ros::WallDuration stream_timeout_;
+
+  // chunks of plans whose first chunk has not been received yet, by plan_id
+  static const size_t MAX_EARLY_STREAMS = 4u;
+  struct EarlyChunks
+  {
+    ros::WallTime last_received;
+    std::map<unsigned int, StepPlanChunk> chunks;
+  };
+  std::map<unsigned int, EarlyChunks> early_chunks_;
+
+  // newest step plan waiting to be merged; must be accessed while holding pending_step_plan_mutex_
+  msgs::StepPlanConstPtr pending_step_plan_;
+  unsigned int coalesced_plans_;
+  boost::mutex pending_step_plan_mutex_; // lock level 2
+
+  // backpressure: queue capacity and merge rate budgets
+  int max_queue_size_;
+  ros::WallDuration min_merge_interval_;
+  ros::WallTime last_merge_time_;
+  ros::WallDuration last_merge_duration_;
+  unsigned int merged_plans_;
+  unsigned int rejected_plans_;
+  Backpressure backpressure_;
+
+  // continuous walking
+  bool continuous_mode_;
+  int rebase_step_index_;
+  int64_t step_index_offset_;
+
+  // step plan file paged into the step queue
+  StepPlanFile::Ptr plan_file_;
+  int plan_file_next_step_index_;
+  int plan_file_lookahead_;
+  msgs::StepPlan plan_file_buffer_;
+
+  // version of last published feedback
+  unsigned int last_published_feedback_version_;
+
+  // if true, unchanged feedback is not published again (reduces rate of action feedback to changes)
+  bool feedback_on_change_only_;
+
+  // compact transport for constrained links
+  bool compact_transport_;
+  boost::shared_ptr<CompactStepPlanCodec> compact_step_plan_codec_;
+  CompactFeedbackEncoder compact_feedback_encoder_;
+  CompactFeedback compact_feedback_;
+
+  // reused timeline message and versions of feedback and step queue it has been published for
+  ExecutionTimeline execution_timeline_;
+  unsigned int last_published_timeline_feedback_version_;
+  unsigned int last_published_timeline_queue_version_;
+
+  // if true, heap allocations in steady state cycles are reported (requires allocation hook)
+  bool check_allocations_;
+  boost::atomic<size_t> steady_state_allocations_;
+
+  // if true, invariants of the execution state are checked at the end of each cycle (testing only)
+  bool check_invariants_;
+  boost::atomic<size_t> invariant_violations_;
+
+  // plugin loaded in background waiting to replace step_controller_plugin_
+  StepControllerPlugin::Ptr pending_step_controller_plugin_;
+  boost::atomic<bool> plugin_swap_pending_;
+
+  // emergency stop to be completed by the next update cycle
+  boost::atomic<bool> emergency_stop_pending_;
+  boost::mutex pending_plugin_mutex_; // lock level 2
+
+  // load requests served by plugin_loader_thread_; must be accessed while holding pending_plugin_mutex_
+  std::deque<std::string> plugin_load_requests_;
+  boost::condition_variable plugin_load_condition_;
+  bool plugin_loader_shutdown_;
+  boost::thread plugin_loader_thread_;
+
+  // loads plugins listed in preload_step_controller_plugins at idle priority
+  boost::thread plugin_preload_thread_;
+
+  // initialized plugins ready to be swapped in; must be accessed while holding pending_plugin_mutex_
+  std::map<std::string, StepControllerPlugin::Ptr> preloaded_plugins_;
+
+  // time from construction until ready to walk
+  ros::WallDuration startup_time_;
+
+  // worker pool precomputing data of queued steps
+  StepPreprocessor::Ptr step_preprocessor_;
+
+  // health and performance figures
+  StepControllerDiagnostics::Ptr diagnostics_;
+
+  // persisted execution state for respawn recovery
+  ExecutionCheckpoint::Ptr checkpoint_;
+
+  // introspection of step queue
+  StepQueueIntrospection::Ptr step_queue_introspection_;
+
   /// ROS API
 
+  /**
+   * @brief Creates a dedicated callback spinner for the given callback group if configured by the
+   * parameters callback_groups/<group>/threads (0 keeps the group on the global queue) and
+   * callback_groups/<group>/priority.
+   * @param nh Node handle of the controller
+   * @param group Name of callback group
+   * @param max_threads Upper bound of threads the callbacks of the group may run on
+   * @param group_nh [out] Node handle which must be used for all callbacks of the group
+   * @return Spinner serving the group or null pointer if the group stays on the global queue
+   */
+  CallbackSpinner::Ptr createCallbackSpinner(ros::NodeHandle& nh, const std::string& group, int max_threads, ros::NodeHandle& group_nh) const;
+
   // subscriber
   void loadStepPlanMsgPlugin(const std_msgs::StringConstPtr& plugin_name);
   void loadStepControllerPlugin(const std_msgs::StringConstPtr& plugin_name);
-  void executeStepPlan(const msgs::StepPlanConstPtr& step_plan);
+  void executeStepPlanChunk(const StepPlanChunkConstPtr& chunk);
+  void executeStepPlanFile(const std_msgs::StringConstPtr& file_name);
+  void executeStepPlanCompact(const CompactStepPlanConstPtr& compact_step_plan);
+  void emergencyStop(const std_msgs::EmptyConstPtr& empty);
+  void applyDriftCorrection(const geometry_msgs::TransformConstPtr& correction);
 
   // action server calls
   void executeStepPlanAction(ExecuteStepPlanActionServerPtr& as);
   void executePreemptionAction(ExecuteStepPlanActionServerPtr& as);
 
+  // callback groups served by dedicated threads, so large step plans, plugin loads or action requests do not delay control cycles
+  CallbackSpinner::Ptr ingestion_spinner_;
+  CallbackSpinner::Ptr action_spinner_;
+  CallbackSpinner::Ptr plugin_spinner_;
+  CallbackSpinner::Ptr control_spinner_;
+
   // subscriber
   ros::Subscriber load_step_plan_msg_plugin_sub_;
   ros::Subscriber load_step_controller_plugin_sub_;
   ros::Subscriber execute_step_plan_sub_;
+  ros::Subscriber execute_step_plan_chunk_sub_;
+  ros::Subscriber execute_step_plan_file_sub_;
+  ros::Subscriber execute_step_plan_compact_sub_;
+  ros::Subscriber drift_correction_sub_;
+
+  // emergency stop is served by a dedicated thread, so it is never queued behind other callbacks
+  ros::CallbackQueue emergency_stop_queue_;
+  boost::shared_ptr<ros::AsyncSpinner> emergency_stop_spinner_;
+  ros::Subscriber emergency_stop_sub_;
 
   // publisher
   ros::Publisher planning_feedback_pub_;
+  ros::Publisher compact_feedback_pub_;
+  ros::Publisher execution_timeline_pub_;
+  ros::Publisher backpressure_pub_;
 
   // action servers
   boost::shared_ptr<ExecuteStepPlanActionServer> execute_step_plan_as_;
 
   // timer for updating periodically
   ros::Timer update_timer_;
+
+  // one-shot timer waking up the update loop at the next send deadline
+  ros::Timer deadline_timer_;
 };
 }
 
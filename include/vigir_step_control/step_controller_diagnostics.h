@@ -0,0 +1,200 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_CONTROLLER_DIAGNOSTICS_H__
+#define VIGIR_STEP_CONTROLLER_DIAGNOSTICS_H__
+
+#include <ros/ros.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <vigir_step_control/step_controller_plugin.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Collects health and performance figures of the step controller and publishes them as
+ * diagnostic_msgs. All record methods are lock-free and allocation-free, so they can be called
+ * in the control loop. The statistics are evaluated and published by a low priority thread.
+ */
+class StepControllerDiagnostics
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<StepControllerDiagnostics> Ptr;
+  typedef boost::shared_ptr<const StepControllerDiagnostics> ConstPtr;
+
+  /**
+   * @brief StepControllerDiagnostics
+   * @param nh Nodehandle used for publishing
+   * @param expected_rate Nominal update rate of control loop [Hz]; 0 if the loop is not scheduled periodically
+   * @param rate Publishing rate [Hz]
+   */
+  StepControllerDiagnostics(ros::NodeHandle& nh, double expected_rate, double rate = 1.0);
+  virtual ~StepControllerDiagnostics();
+
+  /**
+   * @brief Sets step queue to be monitored. This method is lock-free.
+   * @param step_queue Step queue of active step controller plugin
+   */
+  void setStepQueue(StepQueue::ConstPtr step_queue);
+
+  /**
+   * @brief Records a completed update cycle of the control loop.
+   * @param start Start time of cycle
+   * @param end End time of cycle
+   */
+  void recordCycle(const ros::WallTime& start, const ros::WallTime& end);
+
+  /**
+   * @brief Records the time needed to merge a step plan into the step queue.
+   * @param latency Merge latency
+   */
+  void recordMerge(const ros::WallDuration& latency);
+
+  /**
+   * @brief Records a step plan or chunk rejected by the controller as it would exceed the maximum queue size.
+   */
+  void recordRejectedPlan();
+
+  /**
+   * @brief Records chunks of streamed step plans which have been dropped without being merged.
+   * @param chunks Number of dropped chunks
+   */
+  void recordDroppedChunks(size_t chunks);
+
+  /**
+   * @brief Records a stream which has been completed as no further chunk has been received in time.
+   */
+  void recordStreamTimeout();
+
+  /**
+   * @brief Records steps handed over to the walking engine.
+   * @param steps Number of sent steps
+   */
+  void recordStepsSent(int steps);
+
+  /**
+   * @brief Records current state of execution.
+   * @param state Current state
+   */
+  void recordState(StepControllerState state);
+
+  /**
+   * @brief Records detected violations of execution state invariants.
+   * @param violations Number of violations
+   */
+  void recordInvariantViolations(unsigned int violations);
+
+  /**
+   * @brief Records latency of an emergency stop until it has been forwarded to the walking engine.
+   * @param latency Measured latency
+   */
+  void recordEmergencyStop(const ros::WallDuration& latency);
+
+  /**
+   * @brief Records time needed by the controller from construction until it was ready to walk.
+   * @param duration Measured startup time
+   */
+  void recordStartup(const ros::WallDuration& duration);
+
+protected:
+  // bucket i of the merge latency histogram counts latencies in (2^(i-1); 2^i] * MERGE_LATENCY_RESOLUTION
+  static const size_t MERGE_LATENCY_BUCKETS = 20u;
+  static const int64_t MERGE_LATENCY_RESOLUTION = 10000; // [ns]
+
+  void run();
+
+  /**
+   * @brief Evaluates all statistics recorded since last call.
+   * @param status Resulting diagnostic status
+   */
+  void generateStatus(diagnostic_msgs::DiagnosticStatus& status);
+
+  /**
+   * @brief Returns upper bound of the merge latency below which the given share of all merges fall.
+   * @param histogram Merge latency histogram
+   * @param count Total number of merges
+   * @param percentile Requested share in [0; 1]
+   * @return Merge latency [s]
+   */
+  double getMergeLatencyPercentile(const size_t* histogram, size_t count, double percentile) const;
+
+  ros::WallDuration expected_period_;
+  ros::WallDuration period_;
+
+  // control loop statistics (lock-free)
+  ros::WallTime last_cycle_start_; // written by control loop only
+  boost::atomic<size_t> cycle_count_;
+  boost::atomic<size_t> overrun_count_;
+  boost::atomic<int64_t> max_cycle_duration_;
+  boost::atomic<int64_t> max_cycle_interval_;
+  boost::atomic<int> state_;
+
+  // execution statistics (lock-free)
+  boost::atomic<size_t> steps_sent_;
+  boost::atomic<size_t> invariant_violations_;
+
+  // requests refused by the controller itself (lock-free); rejections of the step queue are reported by the queue
+  boost::atomic<size_t> rejected_plans_;
+  boost::atomic<size_t> dropped_chunks_;
+  boost::atomic<size_t> stream_timeouts_;
+
+  // emergency stop
+  boost::atomic<size_t> emergency_stop_count_;
+  boost::atomic<int64_t> last_emergency_stop_latency_; // [ns]
+  boost::atomic<int64_t> max_emergency_stop_latency_; // [ns]
+
+  // startup
+  boost::atomic<int64_t> startup_time_; // [ns]
+  boost::atomic<size_t> merge_latency_histogram_[MERGE_LATENCY_BUCKETS];
+
+  // monitored step queue; must be accessed by boost::atomic_load/atomic_store only
+  StepQueue::ConstPtr step_queue_;
+
+  // values at last evaluation (publishing thread only)
+  ros::WallTime last_evaluation_;
+  size_t last_cycle_count_;
+  size_t last_overrun_count_;
+  size_t last_steps_sent_;
+  size_t last_invariant_violations_;
+
+  // publisher
+  ros::Publisher diagnostics_pub_;
+
+  boost::thread thread_;
+};
+}
+
+#endif
@@ -31,11 +31,19 @@
 
 #include <ros/ros.h>
 
+#include <deque>
+#include <future>
+
+#include <boost/atomic.hpp>
+
 #include <vigir_pluginlib/plugin.h>
 
 #include <vigir_footstep_planning_plugins/plugins/step_plan_msg_plugin.h>
 
+#include <vigir_step_control/ExecutionTimeline.h>
+#include <vigir_step_control/step_preprocessor.h>
 #include <vigir_step_control/step_queue.h>
+#include <vigir_step_control/step_control_log.h>
 
 
 
@@ -54,7 +62,72 @@ enum StepControllerState
 };
 
 std::string toString(const StepControllerState& state);
+const char* toCString(const StepControllerState& state);
+
+/**
+ * @brief Completion token of an asynchronous step execution request. The value becomes true when the
+ * walking engine has accepted the step and false if the request has failed.
+ */
+typedef std::shared_future<bool> StepExecutionToken;
+
+/**
+ * @brief Immutable snapshot of the execution state of a StepControllerPlugin.
+ */
+struct StepControllerSnapshot
+{
+  typedef boost::shared_ptr<const StepControllerSnapshot> ConstPtr;
+
+  StepControllerState state;
+  int next_step_index_needed;
+  int last_step_index_sent;
+  msgs::ExecuteStepPlanFeedback feedback;
+  int replan_invalidated_steps;
+
+  StepQueue::Snapshot::ConstPtr queue;
+};
+
+/**
+ * @brief Cost statistics of merging step plan updates during execution.
+ */
+struct StepReplanStats
+{
+  StepReplanStats()
+    : replan_count(0u)
+    , last_invalidated_steps(0)
+    , total_invalidated_steps(0u)
+    , total_preserved_steps(0u)
+  {}
+
+  // number of step plan updates merged while walking
+  unsigned int replan_count;
+
+  // number of already sent steps which had to be re-sent due to the last update
+  int last_invalidated_steps;
 
+  // accumulated number of re-sent steps
+  size_t total_invalidated_steps;
+
+  // accumulated number of sent steps which have not been re-sent as they were unchanged
+  size_t total_preserved_steps;
+};
+
+/**
+ * @brief Base class of all step controller plugins.
+ *
+ * Threading model: The execution state (step queue content, state, step indices, feedback and configuration)
+ * has a single owner, which is the thread currently holding the controller lock of the StepController. This
+ * includes the update cycle as well as all step plan ingestion callbacks, so they never run concurrently.
+ * All methods of this class have to be called by the owner unless stated otherwise. State, step indices and
+ * feedback version are atomics and may be read by any thread; any other thread has to use getSnapshot().
+ *
+ * Lock levels (a thread holding a lock may only acquire locks of a higher level; locks are not reentrant):
+ * 1. StepController::controller_mutex_ (owner lock)
+ * 2. StepController::pending_plugin_mutex_, StepController::pending_step_plan_mutex_ and StepControllerPlugin::plugin_mutex_
+ * 3. StepQueue::cache_mutex_ and StepControllerPlugin::snapshot_mutex_
+ * 4. StepQueue::queue_mutex_
+ * The base class never acquires plugin_mutex_, so derived classes may use it to guard data shared with
+ * their own threads (e.g. walking engine callbacks).
+ */
 class StepControllerPlugin
   : public vigir_pluginlib::Plugin
 {
@@ -73,37 +146,183 @@ public:
   virtual void setStepPlanMsgPlugin(vigir_footstep_planning::StepPlanMsgPlugin::Ptr plugin);
 
   /**
-   * @brief Get current state of execution.
+   * @brief Reserves memory of the step queue up front.
+   * @param capacity Maximum plan length to be expected
+   * @param fixed If true, the step queue will never allocate additional memory (see StepQueue::reserve)
+   */
+  void setStepQueueCapacity(size_t capacity, bool fixed);
+
+  /**
+   * @brief Sets tolerance used to decide if a step has been changed by a step plan update. Only changed
+   * steps, which have already been sent to the walking engine, are sent again.
+   * @param tolerance Tolerance
+   */
+  void setReplanTolerance(const StepQueue::Tolerance& tolerance);
+
+  /**
+   * @brief Returns cost statistics of merged step plan updates.
+   * @return Replan statistics
+   */
+  StepReplanStats getReplanStats() const;
+
+  /**
+   * @brief Sets the preprocessor whose worker pool precomputes data of queued steps ahead of execution.
+   * @param preprocessor Preprocessor; empty pointer disables preprocessing
+   */
+  void setStepPreprocessor(StepPreprocessor::ConstPtr preprocessor);
+
+  /**
+   * @brief Returns the preprocessing result of the given step, which is intended to be used by executeStep(...).
+   * If the worker pool has not processed the step yet, the stage chain is run synchronously.
+   * @param step Step
+   * @return Preprocessing result; empty pointer if preprocessing is disabled
+   */
+  PreprocessedStep::ConstPtr getPreprocessedStep(const msgs::Step& step) const;
+
+  /**
+   * @brief Returns the step queue used for execution (e.g. for introspection).
+   * @return Step queue
+   */
+  StepQueue::ConstPtr getStepQueue() const;
+
+  /**
+   * @brief Enables asynchronous execution of steps. In this mode, process(...) hands over steps by
+   * executeStepAsync(...) and doesn't wait for its completion. Completed requests advance last_step_index_sent_
+   * in order, while requests not completed within the given timeout result in FAILED state.
+   * @param enable If true, asynchronous execution is used
+   * @param timeout Maximum time [s] a step request may take until completion
+   * @param max_steps_in_flight Maximum number of uncompleted requests at the same time
+   */
+  void setAsyncExecution(bool enable, double timeout = 1.0, unsigned int max_steps_in_flight = 1u);
+
+  /**
+   * @brief Returns if asynchronous execution is enabled.
+   * @return True when asynchronous execution is enabled
+   */
+  bool isAsyncExecutionEnabled() const;
+
+  /**
+   * @brief Enables the timing scheduler which sends each step just-in-time. The send deadline of a step
+   * is computed from the start time of the currently executing step, the step_duration of all steps in
+   * between and the measured acceptance latency of the walking engine. Steps are sent when their deadline
+   * has been reached or next_step_index_needed_ requests them, whichever comes first. Sending steps as late
+   * as possible keeps them changeable for late replanning.
+   * @param enable If true, the timing scheduler is used
+   * @param safety_margin Additional time [s] a step is sent ahead of its deadline
+   */
+  void setDeadlineScheduling(bool enable, double safety_margin = 0.1);
+
+  /**
+   * @brief Enables continuous walking. In this mode the step plan is never considered to be complete, so
+   * execution does not finish when the step queue runs empty. Instead, the walking engine waits for further
+   * segments which are merged by updateStepPlan(...) or appended by extendStepPlan(...) without returning
+   * to READY state. As performed steps are removed from the step queue, memory usage stays constant.
+   * @param enable If true, continuous walking is enabled
+   */
+  void setContinuousMode(bool enable);
+  bool isContinuousModeEnabled() const;
+
+  /**
+   * @brief Shifts all step indices of the execution state (step queue, feedback, sent and requested steps),
+   * so that the first step not performed yet gets the lowest possible index. This keeps step indices bounded
+   * during continuous walking. Derived classes are informed by onRebase(...). Must be called by the owner
+   * at cycle boundaries. The StepController publishes the cumulative offset as Backpressure::step_index_offset,
+   * so planners can rebase their step plans as well.
+   * @return Offset subtracted from all step indices; 0 if nothing has been rebased
+   */
+  int rebaseStepIndices();
+
+  /**
+   * @brief Returns the time when the next step has to be sent by the timing scheduler.
+   * @return Send deadline of next step; zero if there is no deadline known
+   */
+  ros::Time getNextSendDeadline() const;
+
+  /**
+   * @brief Predicts when the given step will be finished. The prediction is anchored to the measured start of
+   * the currently executing step and assumes nominal step durations afterwards. If the currently executing step
+   * takes longer than expected, all predictions are delayed accordingly. Runs in constant time.
+   * @param step_index Step index
+   * @return Predicted finish time; zero if unknown (e.g. not executing or step not in queue)
+   */
+  ros::Time getEstimatedFinishTime(int step_index) const;
+
+  /**
+   * @brief Predicts which step will be executed at the given time (see getEstimatedFinishTime(...)). Runs in O(log n).
+   * @param time Time of interest
+   * @return Step index; -1 if unknown or execution is predicted to be finished until then
+   */
+  int getStepIndexAt(const ros::Time& time) const;
+
+  /**
+   * @brief Generates the predicted execution timeline of all queued steps which have not been finished yet.
+   * @param timeline [out] Predicted execution timeline; contains no steps if unknown
+   */
+  void getExecutionTimeline(ExecutionTimeline& timeline) const;
+
+  /**
+   * @brief Get current state of execution. May be called by any thread.
    * @return StepControllerState
    */
   StepControllerState getState() const;
 
   /**
-   * @brief Returns next step index needed by the walking engine
+   * @brief Returns next step index needed by the walking engine. May be called by any thread.
    * @return step index
    */
   int getNextStepIndexNeeded() const;
 
   /**
-   * @brief Returns last step index which has been sent to walking engine.
+   * @brief Returns last step index which has been sent to walking engine. May be called by any thread.
    * @return step index
    */
   int getLastStepIndexSent() const;
 
   /**
-   * @brief Returns current feedback information provided by the plugin
+   * @brief Returns current feedback information provided by the plugin. The reference is only valid
+   * for the owner of the execution state.
    * @return current feedback
    */
   const msgs::ExecuteStepPlanFeedback& getFeedbackState() const;
 
+  /**
+   * @brief Returns modification counter of feedback state which is incremented on each change. May be
+   * called by any thread.
+   * @return Current version of feedback state
+   */
+  unsigned int getFeedbackVersion() const;
+
   /**
    * @brief Updates feedback information with internal state data.
    */
   void updateQueueFeedback();
 
+  /**
+   * @brief Enables generation of snapshots used for introspection. When disabled (default),
+   * updateSnapshot() does nothing.
+   * @param enable If true, snapshots will be generated
+   */
+  void setSnapshotEnabled(bool enable);
+
+  /**
+   * @brief Generates a new snapshot if the execution state has changed since the last call. The
+   * queue content is not copied here but by the thread calling getSnapshot().
+   * This method does not allocate any memory as long as nothing has changed.
+   */
+  void updateSnapshot();
+
+  /**
+   * @brief Returns latest execution state generated by updateSnapshot() along with the current queue
+   * content. The queue content is copied by the calling thread when it has changed (see StepQueue::getSnapshot()),
+   * so it may be slightly ahead of the execution state. May be called by any thread except the control thread.
+   * @return Latest snapshot; empty pointer if snapshots are disabled
+   */
+  StepControllerSnapshot::ConstPtr getSnapshot() const;
+
   /**
    * @brief Merges given step plan to the current step queue of steps. Hereby, two cases have to considered:
-   * 1. In case of an empty step queue (robot is standing) the step plan has to begin with step index 0.
+   * 1. In case of an empty step queue (robot is standing) the step plan has to begin with step index 0. During
+   * continuous walking, the step plan may also continue with the step the walking engine is waiting for.
    * 2. In case of an non-empty step queue (robot is walking) the first step of the step plan has to be
    * identical with the corresponding step (=same step index) in the step queue. Be aware that already performed
    * steps have been popped from step queue and therefore are not exisiting anymore.
@@ -112,6 +331,31 @@ public:
    */
   virtual void updateStepPlan(const msgs::StepPlan& step_plan);
 
+  /**
+   * @brief Corrects the poses of all changeable steps (step index >= feedback.first_changeable_step_index),
+   * e.g. when localization has corrected odometry drift. The correction is applied lazily by the step queue,
+   * so its costs do not depend on the queue length. Steps already sent but still changeable are sent again.
+   * @param correction Transformation applied to the step poses
+   * @return True if correction has been applied
+   */
+  virtual bool applyDriftCorrection(const tf::Transform& correction);
+
+  /**
+   * @brief Appends the given steps to the step queue while the step plan is still being streamed
+   * in chunks. The first step has to follow immediately the last enqueued step.
+   * @param step_plan Steps to be appended
+   * @return True if steps could be appended
+   */
+  virtual bool extendStepPlan(const msgs::StepPlan& step_plan);
+
+  /**
+   * @brief Marks if the enqueued step plan is complete or further steps are going to be streamed.
+   * While incomplete, the controller waits for missing steps instead of aborting or finishing execution.
+   * @param complete False if further steps are expected
+   */
+  void setStepPlanComplete(bool complete);
+  bool isStepPlanComplete() const;
+
   /**
    * @brief This method is called when new step plan has been enqueued and previously the walk controller state was READY.
    * This method must be override and set state to ACTIVE when everything has been set up successfully.
@@ -150,11 +394,86 @@ public:
    */
   virtual bool executeStep(const msgs::Step& step) = 0;
 
+  /**
+   * @brief Asynchronous variant of executeStep(...) which is used when asynchronous execution is enabled.
+   * Implementations must not block but start the handoff to the walking engine (e.g. via serial link or
+   * service call) and return a token which completes as soon as the step has been accepted.
+   * The default implementation calls executeStep(...) and returns an already completed token.
+   * @param step Step to be executed now
+   * @return Completion token of request
+   */
+  virtual StepExecutionToken executeStepAsync(const msgs::Step& step);
+
   /**
    * @brief Will be called when (soft) stop is requested and resets plugin.
    */
   virtual void stop();
 
+  /**
+   * @brief Stops execution immediately. No further steps are sent until the owner has completed the stop by
+   * completeEmergencyStop(...) and onEmergencyStop() is called to forward the stop to the walking engine. In contrast
+   * to all other methods, this method may be called by any thread at any time, even while the owner is busy (e.g.
+   * merging a step plan).
+   */
+  void emergencyStop();
+
+  /**
+   * @brief Returns number of emergency stops requested so far. May be called by any thread.
+   * @return Number of requests
+   */
+  unsigned int getEmergencyStopRequests() const;
+
+  /**
+   * @brief Completes all emergency stops up to the given number of requests, so execution may be started again.
+   * Stops requested afterwards stay active. Hence, the number of requests has to be retrieved before the plugin
+   * is reset. Resetting the plugin alone never clears an emergency stop.
+   * @param requests Number of requests as returned by getEmergencyStopRequests()
+   */
+  void completeEmergencyStop(unsigned int requests);
+
+  /**
+   * @brief Returns if an emergency stop has been requested which has not been completed yet. May be called by any thread.
+   * @return True if emergency stop is active
+   */
+  bool isEmergencyStopped() const;
+
+  /**
+   * @brief Takes over the complete execution state (step queue, indices and feedback) of another
+   * plugin instance in order to continue a running execution seamlessly. This is used for hot-swapping
+   * plugins while walking. The previous plugin is left behind with an empty step queue.
+   * Overwrite this method to take over additional robot specific data, but don't forget to call
+   * the default implementation.
+   * @param previous Plugin instance to be replaced
+   */
+  virtual void takeOver(StepControllerPlugin& previous);
+
+  /**
+   * @brief Restores a running execution from a checkpoint, e.g. after the node has been respawned.
+   * Only executions in progress (ACTIVE or PAUSED) are restored. The walking engine may have continued
+   * or stopped meanwhile, so execution is resumed in ACTIVE state only if confirmEngineState(...) confirms
+   * the restored state; otherwise it is restored as PAUSED and must be stopped (e.g. by an empty step plan)
+   * before a new plan is accepted. Step plans received meanwhile are rejected.
+   * @param checkpoint Snapshot of execution state
+   * @return True if execution has been restored
+   */
+  virtual bool restore(const StepControllerSnapshot& checkpoint);
+
+  /**
+   * @brief Called by restore(...) to resynchronize with the walking engine. Overwrite this method when the
+   * walking engine can report its state, e.g. the last performed step. The default implementation confirms nothing.
+   * @param checkpoint Snapshot of execution state to be resumed
+   * @return True if the walking engine continues exactly the given execution, so it may be resumed as ACTIVE
+   */
+  virtual bool confirmEngineState(const StepControllerSnapshot& /*checkpoint*/) { return false; }
+
+  /**
+   * @brief Verifies invariants of the execution state, e.g. no step beyond the end of the step queue
+   * has been sent. Each violation is reported as error. This check is expensive and intended for testing only.
+   * Overwrite this method to check robot specific invariants, but don't forget to call the default implementation.
+   * @return Number of violated invariants
+   */
+  virtual unsigned int checkInvariants() const;
+
 protected:
   /**
    * @brief Resets the plugin (called during construction and by stop()).
@@ -162,33 +481,218 @@ protected:
    */
   virtual void reset();
 
+  /**
+   * @brief Called by emergencyStop() from an arbitrary thread. Overwrite this method to send a stop command to
+   * the walking engine directly. Implementations must return within microseconds: They must not access the
+   * execution state except atomics and must not wait for any lock which may be held by the owner.
+   */
+  virtual void onEmergencyStop() {}
+
+  /**
+   * @brief Called by rebaseStepIndices() after all step indices of the execution state have been shifted.
+   * Overwrite this method to translate step indices held by the walking engine or by derived classes.
+   * @param offset Offset subtracted from all step indices
+   */
+  virtual void onRebase(int /*offset*/) {}
+
   void setState(StepControllerState state);
 
   void setNextStepIndexNeeded(int index);
 
   void setLastStepIndexSent(int index);
 
+  /**
+   * @brief Lowers last_step_index_sent_ so that all steps from the given index on are sent again. The index
+   * is never advanced here, as only completed execution requests may mark steps as sent.
+   * @param step_index First step index to be sent again
+   */
+  void resendStepsFrom(int step_index);
+
   void setFeedbackState(const msgs::ExecuteStepPlanFeedback& feedback);
 
+  /**
+   * @brief Tracks start time of currently executing step which is needed by the timing scheduler
+   * and the execution timeline.
+   */
+  void updateExecutionTiming();
+
+  /**
+   * @brief Returns by how much the currently executing step has exceeded its nominal step duration.
+   * @return Delay of execution timeline; zero if the step is still on time
+   */
+  ros::Duration getExecutionDelay() const;
+
+  /**
+   * @brief Updates estimation of walking engine's acceptance latency by given measurement.
+   * @param latency Measured time needed for handing over a step
+   */
+  void updateAcceptanceLatency(const ros::WallDuration& latency);
+
+  /**
+   * @brief Computes send deadline of given step.
+   * @param step_index Step index
+   * @return Send deadline; zero if unknown
+   */
+  ros::Time getSendDeadline(int step_index) const;
+
+  /**
+   * @brief Checks if the timing scheduler requests to send the given step now.
+   * @param step_index Step index
+   * @return True if deadline of step has been reached
+   */
+  bool isSendDeadlineReached(int step_index) const;
+
+  /**
+   * @brief Asynchronous counterpart of spoolSteps(...): Tracks completion of all steps in flight and
+   * requests new steps in (last requested step index; next_step_index_needed_] via executeStepAsync(...).
+   */
+  void spoolStepsAsync();
+
+  /**
+   * @brief Removes all steps up to feedback.last_performed_step_index from the step queue. The queue
+   * is only touched when the walking engine has performed further steps since the last call.
+   */
+  void removePerformedSteps();
+
+  /**
+   * @brief Discards all uncompleted step requests with step index >= given index. Their results will be ignored.
+   * @param step_index First step index to be discarded
+   */
+  void discardStepsInFlight(int step_index = 0);
+
+  /**
+   * @brief Spools all requested steps in (last_step_index_sent_; next_step_index_needed_] to the walking
+   * engine and removes already performed steps from queue. This is the default behavior of process(...).
+   * The executor is passed as template parameter, so derived classes are able to call executeStep(...)
+   * without virtual dispatch (see StaticStepControllerPlugin).
+   * @param execute Callable with signature bool(const msgs::Step& step)
+   */
+  template<typename Executor>
+  void spoolSteps(Executor execute)
+  {
+    updateExecutionTiming();
+
+    while (!isEmergencyStopped() && (getLastStepIndexSent() < getNextStepIndexNeeded() || isSendDeadlineReached(getLastStepIndexSent()+1)))
+    {
+      // determine next step index
+      int next_step_index = getLastStepIndexSent()+1;
+
+      // retrieve next step
+      if (!step_queue_->getStep(step_buffer_, next_step_index))
+      {
+        // step may not have been streamed yet
+        if (!step_queue_->isPlanComplete())
+        {
+          STEP_CONTROL_WARN_THROTTLE(1.0, "[StepControllerPlugin] Step %i required but not streamed yet. Waiting...", next_step_index);
+          return;
+        }
+
+        STEP_CONTROL_ERROR("[StepControllerPlugin] Missing step %i in queue. Execution aborted!", next_step_index);
+        setState(FAILED);
+        return;
+      }
+
+      // sent step to walking engine
+      ros::WallTime request_time = ros::WallTime::now();
+      if (!execute(step_buffer_))
+      {
+        STEP_CONTROL_ERROR("[StepControllerPlugin] Error while execution request of step %i. Execution aborted!", next_step_index);
+        setState(FAILED);
+        return;
+      }
+      updateAcceptanceLatency(ros::WallTime::now() - request_time);
+
+      // increment last_step_index_sent
+      setLastStepIndexSent(next_step_index);
+    }
+
+    // garbage collection: remove already executed steps
+    removePerformedSteps();
+
+    // update feedback
+    updateQueueFeedback();
+  }
+
+  /**
+   * @brief Modifies the feedback state in place which avoids any copies of the feedback message.
+   * @param modifier Callable with signature void(msgs::ExecuteStepPlanFeedback& feedback)
+   */
+  template<typename Modifier>
+  void updateFeedbackState(Modifier modifier)
+  {
+    modifier(feedback_state_);
+    feedback_version_++;
+  }
+
   StepQueue::Ptr step_queue_;
 
   vigir_footstep_planning::StepPlanMsgPlugin::Ptr step_plan_msg_plugin_;
 
-  // mutex to ensure thread safeness
+  StepPreprocessor::ConstPtr step_preprocessor_;
+
+  // reused memory for steps retrieved from queue (control thread only)
+  msgs::Step step_buffer_;
+
+  // asynchronous step execution (owner only; step plan updates discard requests, too)
+  struct StepInFlight
+  {
+    int step_index;
+    ros::WallTime request_time;
+    StepExecutionToken token;
+  };
+
+  bool async_execution_;
+  ros::WallDuration async_execution_timeout_;
+  unsigned int max_steps_in_flight_;
+  std::deque<StepInFlight> steps_in_flight_;
+
+  // timing scheduler and execution timeline (control thread only)
+  bool deadline_scheduling_;
+  ros::Duration deadline_safety_margin_;
+  int timing_step_index_;
+  ros::Time timing_step_start_;
+  mutable std::vector<double> finish_times_buffer_;
+  double acceptance_latency_mean_;
+  double acceptance_latency_deviation_;
+
+  // continuous walking (control thread only)
+  bool continuous_mode_;
+
+  // last step index removed from step queue (control thread only)
+  int last_removed_step_index_;
+
+  // mutex for data shared with threads of derived classes; unused by the base class (see lock levels)
   mutable boost::shared_mutex plugin_mutex_;
 
 private:
   // current state of walk controller
-  StepControllerState state_;
+  boost::atomic<StepControllerState> state_;
 
   // next step index needed by walk engine
-  int next_step_index_needed_;
+  boost::atomic<int> next_step_index_needed_;
 
   // last step index sent to walk engine
-  int last_step_index_sent_;
+  boost::atomic<int> last_step_index_sent_;
+
+  // emergency stop is active while not all requests have been completed by the owner
+  boost::atomic<unsigned int> emergency_stop_requests_;
+  boost::atomic<unsigned int> emergency_stops_completed_;
 
   // contains current feedback state; should be updated in each cycle
   msgs::ExecuteStepPlanFeedback feedback_state_;
+  boost::atomic<unsigned int> feedback_version_;
+
+  // cost of merged step plan updates
+  StepReplanStats replan_stats_;
+
+  // latest execution state without queue content; must be accessed by boost::atomic_load/atomic_store only
+  bool snapshot_enabled_;
+  StepControllerSnapshot::ConstPtr snapshot_;
+
+  // latest snapshot including queue content composed by getSnapshot() along with the execution state used for it
+  mutable StepControllerSnapshot::ConstPtr composed_snapshot_;
+  mutable StepControllerSnapshot::ConstPtr composed_state_;
+  mutable boost::mutex snapshot_mutex_; // lock level 3
 };
 }
 
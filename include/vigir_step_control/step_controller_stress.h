@@ -0,0 +1,213 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_CONTROLLER_STRESS_H__
+#define VIGIR_STEP_CONTROLLER_STRESS_H__
+
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <std_msgs/String.h>
+
+#include <vigir_step_control/step_controller.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Stress test of the StepController under concurrent load. Several ingestion threads feed random
+ * valid and invalid step plans, empty step plans (soft stop), emergency stops and plugin reload requests into the controller,
+ * while another thread runs the update cycle at a high rate. Invariants of the execution state are checked
+ * at the end of each update cycle. Throughput, update latencies and invariant violations are reported.
+ */
+class StepControllerStress
+{
+public:
+  StepControllerStress(ros::NodeHandle& nh);
+  virtual ~StepControllerStress();
+
+  /**
+   * @brief Runs the stress test for the configured duration and reports the results.
+   * @return True if no invariant has been violated
+   */
+  bool run();
+
+protected:
+  enum PlanType
+  {
+    VALID_PLAN,
+    INVALID_PLAN,
+    EMPTY_PLAN,
+    PLUGIN_RELOAD,
+    EMERGENCY_STOP,
+    NUM_PLAN_TYPES
+  };
+
+  /**
+   * @brief Exposes the plugin reload request, the current step queue and the merge results of the controller.
+   */
+  class Controller
+    : public StepController
+  {
+  public:
+    Controller(ros::NodeHandle& nh)
+      : StepController(nh, false)
+    {}
+
+    void reloadStepControllerPlugin(const std::string& plugin_name)
+    {
+      std_msgs::StringPtr msg(new std_msgs::String());
+      msg->data = plugin_name;
+      loadStepControllerPlugin(msg);
+    }
+
+    /**
+     * @brief Determines the range of step indices a new step plan may start at in order to be mergeable
+     * into the current queue. A step plan starting at min_index has to reach at least max_index.
+     * @param min_index [out] Smallest valid start index
+     * @param max_index [out] Largest valid start index, which is the first step being merged
+     */
+    void getValidStartIndexRange(int& min_index, int& max_index)
+    {
+      boost::shared_lock<boost::shared_mutex> lock(controller_mutex_);
+
+      min_index = max_index = 0;
+
+      if (!step_controller_plugin_)
+        return;
+
+      // queue gets reset by the next merge
+      StepControllerState state = step_controller_plugin_->getState();
+      if (state == FINISHED || state == FAILED)
+        return;
+
+      StepQueue::ConstPtr step_queue = step_controller_plugin_->getStepQueue();
+      int first_step_index = step_queue->firstStepIndex();
+      int last_step_index = step_queue->lastStepIndex();
+      if (first_step_index < 0 || last_step_index < first_step_index)
+        return;
+
+      min_index = first_step_index;
+      max_index = std::min(std::max(step_controller_plugin_->getFeedbackState().first_changeable_step_index, first_step_index), last_step_index);
+    }
+
+    /**
+     * @brief Returns the merge results counted by the controller and its current step queue.
+     * @param merged [out] Number of step plans passed to the plugin
+     * @param coalesced [out] Number of step plans superseded before being merged
+     * @param rejected [out] Number of step plans rejected due to the maximum queue size
+     * @param queue_rejects [out] Number of step plans rejected by the step queue for each StepQueue::RejectReason
+     */
+    void getMergeResults(size_t& merged, size_t& coalesced, size_t& rejected, std::vector<size_t>& queue_rejects)
+    {
+      boost::shared_lock<boost::shared_mutex> lock(controller_mutex_);
+
+      merged = merged_plans_;
+      rejected = rejected_plans_;
+      {
+        boost::unique_lock<boost::mutex> pending_lock(pending_step_plan_mutex_);
+        coalesced = coalesced_plans_;
+      }
+
+      queue_rejects.assign(StepQueue::NUM_REJECT_REASONS, 0u);
+      if (step_controller_plugin_)
+      {
+        StepQueue::ConstPtr step_queue = step_controller_plugin_->getStepQueue();
+        for (size_t i = 0; i < queue_rejects.size(); i++)
+          queue_rejects[i] = step_queue->getRejectCount(static_cast<StepQueue::RejectReason>(i));
+      }
+    }
+  };
+
+  /**
+   * @brief Ingestion thread feeding random requests into the controller.
+   * @param thread_index Index of thread
+   */
+  void ingest(unsigned int thread_index);
+
+  /**
+   * @brief Update thread calling the update cycle of the controller at the configured rate.
+   */
+  void spin();
+
+  /**
+   * @brief Generates a step plan where the content of each step only depends on its step index and
+   * the given variant, so plans of different variants overlap consistently at their first step.
+   * @param step_plan Outgoing step plan
+   * @param start_index Step index of first step
+   * @param length Number of steps
+   * @param variant Variant of all steps following the first one
+   */
+  void generateStepPlan(msgs::StepPlan& step_plan, int start_index, int length, int variant) const;
+
+  /**
+   * @brief Corrupts the given step plan randomly (gap, duplicate step index or foot index mismatch).
+   * @param step_plan Step plan to be corrupted
+   * @param random Random number generator
+   */
+  void corruptStepPlan(msgs::StepPlan& step_plan, std::mt19937& random) const;
+
+  /**
+   * @brief Returns given percentile of the recorded update latencies.
+   * @param latencies Latencies sorted in ascending order
+   * @param percentile Percentile in [0; 1]
+   * @return Latency [s]
+   */
+  double getLatencyPercentile(const std::vector<double>& latencies, double percentile) const;
+
+  boost::shared_ptr<Controller> controller_;
+
+  // configuration
+  ros::WallDuration duration_;
+  unsigned int ingestion_threads_;
+  double ingestion_rate_;
+  double update_rate_;
+  int plan_length_;
+  double invalid_plan_ratio_;
+  double empty_plan_ratio_;
+  double reload_ratio_;
+  double emergency_stop_ratio_;
+  std::string reload_plugin_;
+  unsigned int seed_;
+
+  // results
+  boost::atomic<bool> running_;
+  boost::atomic<size_t> requests_[NUM_PLAN_TYPES];
+  std::vector<double> update_latencies_;
+};
+}
+
+#endif
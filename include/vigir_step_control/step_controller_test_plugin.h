@@ -31,7 +31,7 @@
 
 #include <ros/ros.h>
 
-#include <vigir_step_control/step_controller_plugin.h>
+#include <vigir_step_control/static_step_controller_plugin.h>
 
 
 
@@ -40,7 +40,7 @@ namespace vigir_step_control
 using namespace vigir_footstep_planning_msgs;
 
 class StepControllerTestPlugin
-  : public StepControllerPlugin
+  : public StaticStepControllerPlugin<StepControllerTestPlugin>
 {
 public:
   // typedefs
@@ -70,7 +70,26 @@ public:
    */
   bool executeStep(const msgs::Step& step) override;
 
+  /**
+   * @brief Takes over fake execution timing in addition to the default behavior.
+   * @param previous Plugin instance to be replaced
+   */
+  void takeOver(StepControllerPlugin& previous) override;
+
+  /**
+   * @brief The fake walking engine is simulated by this plugin, so a restored execution is always
+   * continued from the checkpointed state.
+   * @param checkpoint Snapshot of execution state to be resumed
+   * @return Returns always true
+   */
+  bool confirmEngineState(const StepControllerSnapshot& checkpoint) override;
+
 protected:
+  /**
+   * @brief Halts fake execution immediately.
+   */
+  void onEmergencyStop() override;
+
   ros::Time next_step_needed_time_;
 };
 }
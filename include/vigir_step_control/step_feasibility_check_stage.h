@@ -0,0 +1,60 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_FEASIBILITY_CHECK_STAGE_H__
+#define VIGIR_STEP_FEASIBILITY_CHECK_STAGE_H__
+
+#include <ros/ros.h>
+
+#include <vigir_step_control/step_preprocessing_stage.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Example preprocessing stage which rejects steps marked as invalid or colliding by the planner
+ * as well as steps with negative timing parameters.
+ */
+class StepFeasibilityCheckStage
+  : public StepPreprocessingStage
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<StepFeasibilityCheckStage> Ptr;
+  typedef boost::shared_ptr<const StepFeasibilityCheckStage> ConstPtr;
+
+  StepFeasibilityCheckStage();
+  virtual ~StepFeasibilityCheckStage();
+
+  bool process(msgs::Step& step, boost::any& data) const override;
+};
+}
+
+#endif
@@ -0,0 +1,188 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_CONTROL_STEP_PLAN_FILE_H__
+#define VIGIR_STEP_CONTROL_STEP_PLAN_FILE_H__
+
+#include <ros/ros.h>
+
+#include <vigir_footstep_planning_msgs/footstep_planning_msgs.h>
+
+
+
+namespace vigir_step_control
+{
+using namespace vigir_footstep_planning;
+
+/**
+ * @brief Read-only step plan stored in a compact binary file which is mapped into memory. Opening a file
+ * only validates its header, so start-up costs and memory usage do not depend on the plan length. Steps
+ * are decoded directly from the mapping when requested, hence the kernel pages in only those parts of
+ * the file which are actually read. Pages of steps which are not needed anymore can be released.
+ * File layout: FileHeader, step records of all steps ordered by step index, opaque plan data. All values
+ * are stored in host byte order.
+ */
+class StepPlanFile
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<StepPlanFile> Ptr;
+  typedef boost::shared_ptr<const StepPlanFile> ConstPtr;
+
+  /**
+   * @brief StepPlanFile
+   * @param file_name Path of step plan file
+   */
+  StepPlanFile(const std::string& file_name);
+  virtual ~StepPlanFile();
+
+  /**
+   * @brief Writes given step plan into a step plan file (e.g. converted from a bag file).
+   * @param file_name Path of step plan file; will be overwritten if existing
+   * @param step_plan Step plan which must contain a continuous sequence of steps
+   * @return True if file has been written successfully
+   */
+  static bool write(const std::string& file_name, const msgs::StepPlan& step_plan);
+
+  /**
+   * @brief Checks if the step plan file could be mapped into memory.
+   * @return True if step plan file is usable
+   */
+  bool isOpen() const;
+
+  const std::string& getFileName() const { return file_name_; }
+
+  /**
+   * @brief Returns number of steps in file.
+   * @return Number of steps
+   */
+  size_t size() const;
+
+  /**
+   * @brief Returns step index of the first step in file.
+   * @return Step index; -1 if file contains no steps
+   */
+  int firstStepIndex() const;
+
+  /**
+   * @brief Returns step index of the last step in file.
+   * @return Step index; -1 if file contains no steps
+   */
+  int lastStepIndex() const;
+
+  /**
+   * @brief Decodes a single step from the file.
+   * @param step [out] Step
+   * @param step_index Step index
+   * @return True if step is in file
+   */
+  bool getStep(msgs::Step& step, int step_index) const;
+
+  /**
+   * @brief Decodes all steps in range [from_step_index; to_step_index] into the given step plan. Memory already
+   * owned by the step plan is reused. The plan data is only included when the range starts with the first step.
+   * @param step_plan [out] Step plan
+   * @param from_step_index First step index
+   * @param to_step_index Last step index; clamped to the end of the file
+   * @return False if from_step_index is not in file
+   */
+  bool getStepPlan(msgs::StepPlan& step_plan, int from_step_index, int to_step_index) const;
+
+  /**
+   * @brief Advises the kernel to page in the steps in range [from_step_index; to_step_index] in background.
+   * @param from_step_index First step index
+   * @param to_step_index Last step index
+   */
+  void prefetch(int from_step_index, int to_step_index) const;
+
+  /**
+   * @brief Releases the pages of all steps with index < step_index from memory. They are read again
+   * from disk if accessed later on.
+   * @param step_index First step index still needed
+   */
+  void release(int step_index) const;
+
+protected:
+  struct Pose
+  {
+    double position[3];
+    double orientation[4];
+  };
+
+  struct FileHeader
+  {
+    uint32_t magic;
+    uint32_t format_version;
+    uint32_t step_count;
+    int32_t first_step_index;
+    uint32_t data_size;
+    uint8_t mode;
+    uint8_t start_foot_index;
+    uint8_t goal_foot_index;
+    uint8_t reserved;
+    Pose start_pose;
+    Pose goal_pose;
+    char frame_id[64];
+  };
+
+  struct StepRecord
+  {
+    int32_t step_index;
+    uint8_t foot_index;
+    uint8_t valid;
+    uint8_t colliding;
+    uint8_t reserved;
+    Pose pose;
+    double step_duration;
+    double sway_duration;
+    double swing_height;
+    double cost;
+    double risk;
+  };
+
+  const FileHeader* header() const { return reinterpret_cast<const FileHeader*>(data_); }
+  const StepRecord* record(int step_index) const { return reinterpret_cast<const StepRecord*>(data_ + sizeof(FileHeader)) + (step_index - header()->first_step_index); }
+
+  /**
+   * @brief Advises the kernel about the expected usage of the given byte range of the mapping.
+   * @param begin First byte
+   * @param end Byte behind range
+   * @param advice madvise advice
+   */
+  void advise(size_t begin, size_t end, int advice) const;
+
+  std::string file_name_;
+
+  int fd_;
+  uint8_t* data_;
+  size_t size_;
+};
+}
+
+#endif
@@ -0,0 +1,115 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_PREPROCESSING_STAGE_H__
+#define VIGIR_STEP_PREPROCESSING_STAGE_H__
+
+#include <ros/ros.h>
+
+#include <boost/any.hpp>
+
+#include <vigir_pluginlib/plugin.h>
+
+#include <vigir_footstep_planning_msgs/footstep_planning_msgs.h>
+
+
+
+namespace vigir_step_control
+{
+using namespace vigir_footstep_planning_msgs;
+
+/**
+ * @brief Result of all preprocessing stages for a single step.
+ */
+struct PreprocessedStep
+{
+  typedef boost::shared_ptr<const PreprocessedStep> ConstPtr;
+
+  PreprocessedStep()
+    : step_index(-1)
+    , step_hash(0u)
+    , feasible(true)
+  {}
+
+  /**
+   * @brief Returns result of given stage.
+   * @param stage Position of stage in the stage chain
+   * @return Pointer to result; null pointer if stage has not provided any result of type T
+   */
+  template<typename T>
+  const T* getData(size_t stage) const
+  {
+    return stage < data.size() ? boost::any_cast<T>(&data[stage]) : nullptr;
+  }
+
+  // step index and content hash of the queued step the result belongs to
+  int step_index;
+  size_t step_hash;
+
+  // step as modified by all stages (e.g. converted to the walking engine's frame)
+  msgs::Step step;
+
+  // false if any stage has rejected the step; subsequent stages are skipped
+  bool feasible;
+
+  // result of each stage in order of the stage chain
+  std::vector<boost::any> data;
+};
+
+/**
+ * @brief Base class of all preprocessing stages. Stages are chained and run by the worker pool of the
+ * StepPreprocessor on queued steps ahead of execution, e.g. for frame conversion, feasibility checks
+ * or swing trajectory precomputation.
+ */
+class StepPreprocessingStage
+  : public vigir_pluginlib::Plugin
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<StepPreprocessingStage> Ptr;
+  typedef boost::shared_ptr<const StepPreprocessingStage> ConstPtr;
+
+  StepPreprocessingStage()
+    : vigir_pluginlib::Plugin("step_preprocessing_stage")
+  {}
+
+  virtual ~StepPreprocessingStage() {}
+
+  /**
+   * @brief Processes a single step. This method is called concurrently by several worker threads, hence
+   * implementations must be thread-safe and must not access the execution state of the step controller.
+   * @param step Step to be processed; modifications are passed to subsequent stages
+   * @param data Outgoing result of this stage
+   * @return False if the step is infeasible
+   */
+  virtual bool process(msgs::Step& step, boost::any& data) const = 0;
+};
+}
+
+#endif
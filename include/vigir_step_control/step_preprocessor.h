@@ -0,0 +1,127 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_PREPROCESSOR_H__
+#define VIGIR_STEP_PREPROCESSOR_H__
+
+#include <ros/ros.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <vigir_step_control/step_preprocessing_stage.h>
+#include <vigir_step_control/step_queue.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Runs a chain of preprocessing stages on a worker pool over queued steps ahead of execution.
+ * Results are cached in the step queue, so executing a step only needs to read precomputed data.
+ * The owner of the execution state triggers preprocessing by schedule(...) which is cheap and never blocks
+ * for longer than a notification; all work is done by the worker threads.
+ * Lock level: mutex_ is level 2 (see StepControllerPlugin) and never held while accessing the step queue.
+ */
+class StepPreprocessor
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<StepPreprocessor> Ptr;
+  typedef boost::shared_ptr<const StepPreprocessor> ConstPtr;
+
+  /**
+   * @brief StepPreprocessor
+   * @param stages Chain of preprocessing stages
+   * @param threads Number of worker threads
+   * @param lookahead Maximum number of steps to be preprocessed ahead
+   */
+  StepPreprocessor(const std::vector<StepPreprocessingStage::ConstPtr>& stages, unsigned int threads, unsigned int lookahead);
+  virtual ~StepPreprocessor();
+
+  /**
+   * @brief Sets the step queue to work on. May be called by any thread.
+   * @param step_queue Step queue
+   */
+  void setStepQueue(StepQueue::ConstPtr step_queue);
+
+  /**
+   * @brief Requests preprocessing of all queued steps within [first_step_index; first_step_index + lookahead).
+   * Workers are only woken up if the window or the queue content has changed since the last call.
+   * @param first_step_index First step index to be preprocessed
+   */
+  void schedule(int first_step_index);
+
+  /**
+   * @brief Runs the stage chain on the given step synchronously. May be called by any thread.
+   * @param step Step to be processed
+   * @param step_hash Content hash of the queued step
+   * @return Preprocessing result
+   */
+  PreprocessedStep::ConstPtr process(const msgs::Step& step, size_t step_hash = 0u) const;
+
+  /**
+   * @brief Returns the number of steps preprocessed by the worker pool.
+   * @return Number of processed steps
+   */
+  size_t getProcessedCount() const;
+
+protected:
+  /**
+   * @brief Main loop of worker threads. The window is partitioned by step index among all workers.
+   * @param worker_index Index of worker
+   */
+  void run(unsigned int worker_index);
+
+  // chain of stages; immutable after construction
+  std::vector<StepPreprocessingStage::ConstPtr> stages_;
+  int lookahead_;
+
+  // must be accessed by boost::atomic_load/atomic_store only
+  StepQueue::ConstPtr step_queue_;
+
+  // current window; changes are announced by incrementing the generation
+  boost::mutex mutex_;
+  boost::condition_variable work_available_;
+  boost::atomic<unsigned int> generation_;
+  int window_begin_;
+  int window_end_;
+
+  // last scheduled state (owner only)
+  int last_first_step_index_;
+  unsigned int last_queue_version_;
+
+  boost::atomic<size_t> processed_count_;
+
+  unsigned int num_workers_;
+  boost::thread_group workers_;
+};
+}
+
+#endif
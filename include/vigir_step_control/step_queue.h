@@ -31,8 +31,13 @@
 
 #include <ros/ros.h>
 
+#include <boost/atomic.hpp>
+
+#include <tf/tf.h>
+
 #include <vigir_footstep_planning_msgs/footstep_planning_msgs.h>
-#include <vigir_footstep_planning_msgs/step_plan.h>
+
+#include <vigir_step_control/step_preprocessing_stage.h>
 
 
 
@@ -40,6 +45,13 @@ namespace vigir_step_control
 {
 using namespace vigir_footstep_planning;
 
+/**
+ * @brief The StepQueue stores all enqueued steps in a ring of preallocated step slots (arena). Slots of
+ * removed steps are recycled instead of freed, so the queue does not allocate any memory as long
+ * as the number of queued steps stays below the reserved capacity.
+ * The queue is modified by the owner of the execution state only (see StepControllerPlugin), while
+ * read access is safe from any thread.
+ */
 class StepQueue
 {
 public:
@@ -47,11 +59,161 @@ public:
   typedef boost::shared_ptr<StepQueue> Ptr;
   typedef boost::shared_ptr<const StepQueue> ConstPtr;
 
+  /**
+   * @brief Immutable copy of the queue content. Snapshots are taken on demand by the reading
+   * thread and only when the queue has been modified since the last one.
+   */
+  struct Snapshot
+  {
+    typedef boost::shared_ptr<const Snapshot> ConstPtr;
+
+    // modification counter of queue when snapshot was taken
+    unsigned int version;
+
+    // all queued steps ordered by step index
+    std::vector<msgs::Step> steps;
+
+    // false while further steps are expected to be streamed
+    bool plan_complete;
+  };
+
+  /**
+   * @brief Usage statistics of the step arena.
+   */
+  struct ArenaStats
+  {
+    // number of allocated step slots
+    size_t capacity;
+
+    // number of used step slots
+    size_t size;
+
+    // maximum number of step slots used at the same time
+    size_t high_water_mark;
+
+    // number of times the arena had to be enlarged
+    size_t grow_count;
+
+    // number of step plans rejected due to exceeded fixed capacity
+    size_t rejected_count;
+  };
+
+  /**
+   * @brief Statistics of the plan cache.
+   */
+  struct CacheStats
+  {
+    // number of step plans which did not need to be validated again
+    size_t validation_hits;
+
+    // number of step plans which had to be validated
+    size_t validation_misses;
+
+    // number of merges which did not change the queue at all
+    size_t noop_merges;
+  };
+
+  /**
+   * @brief Reasons for rejecting a step plan.
+   */
+  enum RejectReason
+  {
+    INCONSISTENT_PLAN = 0,
+    NON_CONTINUOUS_PLAN,
+    INVALID_START_INDEX,
+    NON_OVERLAPPING_PLAN,
+    FOOT_INDEX_MISMATCH,
+    CAPACITY_EXCEEDED,
+    NUM_REJECT_REASONS
+  };
+
+  /**
+   * @brief Tolerances used for comparing steps. Steps within tolerance are considered to be equal.
+   */
+  struct Tolerance
+  {
+    Tolerance(double position = 0.0, double orientation = 0.0, double parameter = 0.0)
+      : position(position)
+      , orientation(orientation)
+      , parameter(parameter)
+    {}
+
+    // maximal euclidean distance of foot positions [m]
+    double position;
+
+    // maximal rotation angle between foot orientations [rad]
+    double orientation;
+
+    // maximal difference of step parameters (step_duration, sway_duration, swing_height)
+    double parameter;
+  };
+
   StepQueue();
   virtual ~StepQueue();
 
+  /**
+   * @brief Computes content hash of all step data relevant for validation and execution.
+   * @param step Step
+   * @return Hash value
+   */
+  static size_t hashStep(const msgs::Step& step);
+
+  /**
+   * @brief Compares two poses with given tolerance.
+   * @param p1 First pose
+   * @param p2 Second pose
+   * @param tolerance Tolerance; by default poses must be exactly equal
+   * @return True if both poses are equal within tolerance
+   */
+  static bool isEqual(const geometry_msgs::Pose& p1, const geometry_msgs::Pose& p2, const Tolerance& tolerance = Tolerance());
+
+  /**
+   * @brief Compares two steps with given tolerance. Step and foot index must always match.
+   * @param s1 First step
+   * @param s2 Second step
+   * @param tolerance Tolerance; by default steps must be exactly equal
+   * @return True if both steps are equal within tolerance
+   */
+  static bool isEqual(const msgs::Step& s1, const msgs::Step& s2, const Tolerance& tolerance = Tolerance());
+
+  /**
+   * @brief Removes all steps from queue. The step slots are kept for later reuse.
+   */
   void reset();
 
+  /**
+   * @brief Reserves memory for the given maximum plan length up front.
+   * @param capacity Number of step slots to be allocated
+   * @param fixed If true, the queue never allocates additional memory and rejects step plans
+   * exceeding the capacity (allocation free steady state mode). Otherwise, the arena is enlarged on demand.
+   */
+  void reserve(size_t capacity, bool fixed = false);
+
+  /**
+   * @brief Returns usage statistics of the step arena. This method is lock-free.
+   * @return Arena statistics
+   */
+  ArenaStats getArenaStats() const;
+
+  /**
+   * @brief Returns number of step plans rejected for given reason. This method is lock-free.
+   * @param reason Reject reason
+   * @return Number of rejected step plans
+   */
+  size_t getRejectCount(RejectReason reason) const;
+
+  /**
+   * @brief Returns statistics of the plan cache. This method is lock-free.
+   * @return Cache statistics
+   */
+  CacheStats getCacheStats() const;
+
+  /**
+   * @brief Sets tolerance used to detect which steps have been actually modified by updateStepPlan(...).
+   * @param tolerance Tolerance
+   */
+  void setMergeTolerance(const Tolerance& tolerance);
+
   /**
    * @brief Checks if there are steps in queue.
    * @return True if any steps has been enqueued.
@@ -66,14 +228,66 @@ public:
 
   /**
    * @brief Merges given step plan to the current execution queue of steps. Hereby, two cases have to considered:
-   * 1. In case of an empty execution queue (robot is standing) the step plan has to begin with step index 0.
+   * 1. In case of an empty execution queue (robot is standing) the step plan has to begin with step index 0. If steps
+   * have been removed from the queue before, the step plan may also continue with the step following the last removed
+   * step (continuous walking).
    * 2. In case of an non-empty execution queue (robot is walking)
    * TODO: Stitching rules, new total step plan length
    * @param step_plan Step plan to be merged into execution queue.
    * @param min_step_index Only steps with index >= min_step_index are considered for merge
+   * @param first_modified_step_index [out] Optional; lowest step index whose content has been changed, added or
+   * removed by the merge with respect to the merge tolerance. All steps below are guaranteed to be unchanged;
+   * they keep their queued content even if the new plan differs within tolerance.
    * @return True if step plan could be merged.
    */
-  bool updateStepPlan(const msgs::StepPlan& step_plan, int min_step_index = 0);
+  bool updateStepPlan(const msgs::StepPlan& step_plan, int min_step_index = 0, int* first_modified_step_index = nullptr);
+
+  /**
+   * @brief Replaces the queue content by the given steps which must originate from a previous
+   * snapshot of a queue (e.g. checkpoint). As these steps have been already validated before,
+   * only the continuity of step indices is checked.
+   * @param steps Continuous sequence of steps
+   * @param plan_complete False if further steps are expected to be streamed
+   * @return True if steps could be restored
+   */
+  bool restore(const std::vector<msgs::Step>& steps, bool plan_complete = true);
+
+  /**
+   * @brief Shifts the step indices of all queued steps, so step index i becomes i - offset. This keeps
+   * indices bounded during continuous walking. Preprocessing results of queued steps are dropped.
+   * @param offset Positive offset; must not exceed the first queued step index
+   * @return True if queue has been rebased
+   */
+  bool rebase(int offset);
+
+  /**
+   * @brief Corrects the pose of all steps with step index >= from_step_index, e.g. when localization has
+   * corrected odometry drift. The correction is stored once and applied lazily whenever a step is read, hence
+   * the costs do not depend on the queue length. Queued steps are kept as merged, so step plan updates can
+   * still be provided in the uncorrected frame of the planner. Subsequent corrections are accumulated.
+   * @param correction Transformation applied to the step poses (corrected_pose = correction * pose)
+   * @param from_step_index First step index to be corrected
+   */
+  void applyCorrection(const tf::Transform& correction, int from_step_index);
+
+  /**
+   * @brief Appends given steps to the end of the execution queue. This is used for step plans being
+   * streamed in chunks. The first step of the given step plan has to follow immediately the last
+   * queued step (or previously removed step when the queue has run empty). Steps are transformed in
+   * the same way as the step plan merged by the last updateStepPlan(...) call.
+   * @param step_plan Steps to be appended
+   * @return True if steps could be appended
+   */
+  bool extendStepPlan(const msgs::StepPlan& step_plan);
+
+  /**
+   * @brief Marks if the enqueued step plan is complete or further steps are going to be streamed
+   * by extendStepPlan(...). An incomplete queue running empty must not be considered as finished.
+   * reset() marks the queue as complete.
+   * @param complete False if further steps are expected
+   */
+  void setPlanComplete(bool complete);
+  bool isPlanComplete() const;
 
   /**
    * @brief Retrieves step of execution queue.
@@ -81,7 +295,32 @@ public:
    * @param index Position of step in queue to be returned. 0 points to the next step to be executed next.
    * @return True If step could been returned.
    */
-  bool getStep(msgs::Step& step, unsigned int step_index = 0u);
+  bool getStep(msgs::Step& step, unsigned int step_index = 0u) const;
+
+  /**
+   * @brief Retrieves step with given step index together with its content hash.
+   * @param step [out] Step
+   * @param step_hash [out] Content hash of the step (including applied stitch transformation)
+   * @param step_index Step index
+   * @return True if step is in queue
+   */
+  bool getStep(msgs::Step& step, size_t& step_hash, unsigned int step_index) const;
+
+  /**
+   * @brief Returns cached preprocessing result of given step. Results are bound to the content of the
+   * queued step, so they are invalidated implicitly when a step plan update modifies the step.
+   * @param step_index Step index
+   * @return Preprocessing result; empty pointer if no valid result is available
+   */
+  PreprocessedStep::ConstPtr getPreprocessedStep(int step_index) const;
+
+  /**
+   * @brief Caches preprocessing result of a step. The result is dropped if the step has been modified or
+   * removed meanwhile. As the cache does not alter the queue content, any thread may call this method.
+   * @param result Preprocessing result
+   * @return True if result has been stored
+   */
+  bool setPreprocessedStep(PreprocessedStep::ConstPtr result) const;
 
   /**
    * @brief Retrieves step of execution queue.
@@ -89,7 +328,7 @@ public:
    * @param position Position of step in queue to be returned. 0 points to the next step to be executed next.
    * @return True If step could been returned.
    */
-  bool getStepAt(msgs::Step& step, unsigned int position = 0u);
+  bool getStepAt(msgs::Step& step, unsigned int position = 0u) const;
 
   /**
    * @brief getSteps Retrieves all steps with index in range of [start_index; end_index]
@@ -100,13 +339,43 @@ public:
   std::vector<msgs::Step> getSteps(unsigned int start_index, unsigned int end_index) const;
 
   /**
-   * @brief Remove steps with specific index from queue.
+   * @brief Returns the accumulated step duration of all steps in range [from_step_index; to_step_index].
+   * Steps not in queue are ignored. The queue maintains a prefix sum over all step durations, so this
+   * query takes constant time.
+   * @param from_step_index start index
+   * @param to_step_index end index
+   * @return Accumulated step duration [s]
+   */
+  double getStepDuration(int from_step_index, int to_step_index) const;
+
+  /**
+   * @brief Determines the step being executed the given time after the start of step from_step_index,
+   * assuming all steps are executed with their nominal step duration. Runs in O(log n).
+   * @param from_step_index Reference step index which must be in queue
+   * @param elapsed Time since start of reference step [s]
+   * @return Step index; -1 if reference step is not in queue or all queued steps are finished until then
+   */
+  int getStepIndexAt(int from_step_index, double elapsed) const;
+
+  /**
+   * @brief Retrieves the predicted finish times of all steps with index >= from_step_index relative to
+   * the start of step from_step_index.
+   * @param from_step_index Reference step index
+   * @param finish_times [out] finish_times[i] is the accumulated step duration of [from_step_index; from_step_index+i]
+   * @return False if reference step is not in queue
+   */
+  bool getStepFinishTimes(int from_step_index, std::vector<double>& finish_times) const;
+
+  /**
+   * @brief Remove steps with specific index from queue. As the queue must not contain gaps,
+   * only the first or last step can be removed.
    * @param step_index Step to be removed
    */
   void removeStep(unsigned int step_index);
 
   /**
-   * @brief Remove steps in the given range [from_step_index, to_step_index]
+   * @brief Remove steps in the given range [from_step_index, to_step_index]. As the queue must not
+   * contain gaps, the range has to include either the first or the last step of the queue.
    * @param from_step_index start index
    * @param to_step_index end index; to_step_index < 0 is equal to removing all steps with index >= from_step_index
    */
@@ -132,12 +401,205 @@ public:
    */
   int lastStepIndex() const;
 
+  /**
+   * @brief Verifies the internal structure of the queue, i.e. each slot holds the step with the expected
+   * step index. This check is expensive and intended for testing only.
+   * @return True if queue is consistent
+   */
+  bool checkIntegrity() const;
+
+  /**
+   * @brief Returns modification counter which is incremented on each change of the queue content.
+   * @return Current version of queue
+   */
+  unsigned int version() const;
+
+  /**
+   * @brief Enables generation of snapshots. Modifications of the queue never pay for snapshots,
+   * as these are taken by the thread calling getSnapshot().
+   * @param enable If true, getSnapshot() provides snapshots
+   */
+  void setSnapshotEnabled(bool enable);
+
+  /**
+   * @brief Returns snapshot of current queue content. If the queue has been modified since the last
+   * snapshot, the content is copied by the calling thread while holding the queue lock shared. Otherwise
+   * the previous snapshot is returned without acquiring any lock. Intended for low rate background threads.
+   * @return Current snapshot; empty pointer if snapshots are disabled
+   */
+  Snapshot::ConstPtr getSnapshot() const;
+
 protected:
-  StepPlan step_plan_;
+  // pose correction applied to all steps from the given step index on
+  struct Correction
+  {
+    int from_step_index;
+    tf::Transform transform;
+    size_t hash;
+  };
+
+  /**
+   * @brief Must be called after each modification of the queue while holding the queue lock.
+   */
+  void modified();
+
+  /**
+   * @brief Updates queue depth and high water mark of the arena statistics. Must be called after each change
+   * of the queue size while holding the queue lock.
+   */
+  void updateArenaSize();
+
+  /**
+   * @brief Returns slot of given step index. Must be called while holding the queue lock.
+   * @param step_index Step index which must be in queue
+   * @return Reference to step slot
+   */
+  inline msgs::Step& slot(int step_index) { return slots_[(head_ + static_cast<size_t>(step_index - first_step_index_)) % slots_.size()]; }
+  inline const msgs::Step& slot(int step_index) const { return slots_[(head_ + static_cast<size_t>(step_index - first_step_index_)) % slots_.size()]; }
+
+  /**
+   * @brief Returns pose correction applicable to given step.
+   * @param step_index Step index
+   * @return Pointer to correction; null pointer if step is not corrected
+   */
+  inline const Correction* getCorrection(int step_index) const
+  {
+    for (std::vector<Correction>::const_reverse_iterator itr = corrections_.rbegin(); itr != corrections_.rend(); itr++)
+    {
+      if (itr->from_step_index <= step_index)
+        return &(*itr);
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Applies pose correction to a step read from its slot.
+   * @param step Step to be corrected
+   */
+  void correctStep(msgs::Step& step) const;
 
-  // mutex to ensure thread safeness
+  /**
+   * @brief Returns content hash of given step including its pose correction.
+   * @param step_index Step index
+   * @return Hash
+   */
+  size_t correctedSlotHash(int step_index) const;
+
+  inline bool hasStep(int step_index) const { return size_ > 0 && step_index >= first_step_index_ && step_index < first_step_index_ + static_cast<int>(size_); }
+
+  /**
+   * @brief Checks consistency of step plan to be enqueued.
+   * @param step_plan Step plan to check
+   * @return True if step plan is consistent and continuous
+   */
+  bool checkStepPlan(const msgs::StepPlan& step_plan);
+
+  /**
+   * @brief Returns content hash of the original step stored in given slot. Must be called while holding the queue lock.
+   * @param step_index Step index which must be in queue
+   * @return Reference to slot hash
+   */
+  inline size_t& slotHash(int step_index) { return slot_hashes_[(head_ + static_cast<size_t>(step_index - first_step_index_)) % slot_hashes_.size()]; }
+  inline const size_t& slotHash(int step_index) const { return slot_hashes_[(head_ + static_cast<size_t>(step_index - first_step_index_)) % slot_hashes_.size()]; }
+  inline PreprocessedStep::ConstPtr& slotResult(int step_index) const { return slot_results_[(head_ + static_cast<size_t>(step_index - first_step_index_)) % slot_results_.size()]; }
+
+  /**
+   * @brief Returns timeline entry of given step, i.e. the accumulated step duration from an arbitrary origin
+   * up to the end of the step. Must be called while holding the queue lock.
+   * @param step_index Step index which must be in queue
+   * @return Reference to end time of step
+   */
+  inline double& slotEndTime(int step_index) { return slot_end_times_[(head_ + static_cast<size_t>(step_index - first_step_index_)) % slot_end_times_.size()]; }
+  inline const double& slotEndTime(int step_index) const { return slot_end_times_[(head_ + static_cast<size_t>(step_index - first_step_index_)) % slot_end_times_.size()]; }
+  inline double slotStartTime(int step_index) const { return slotEndTime(step_index) - slot(step_index).step_duration; }
+
+  /**
+   * @brief Recomputes the timeline of all steps with index >= from_step_index. Entries of preceding steps
+   * stay valid, so removing steps from the front or back of the queue never requires an update.
+   * Must be called while holding the queue lock.
+   * @param from_step_index First step index whose duration may have changed
+   */
+  void updateTimeline(int from_step_index);
+
+  /**
+   * @brief Counts rejected step plan.
+   * @param reason Reject reason
+   */
+  inline void reject(RejectReason reason) { reject_counts_[reason]++; }
+
+  /**
+   * @brief Ensures that the arena can hold the given number of steps. Must be called while holding the queue lock.
+   * @param size Number of steps needed
+   * @return False if the capacity is fixed and too small
+   */
+  bool ensureCapacity(size_t size);
+
+  // ring of step slots; slots_[head_] contains step with index first_step_index_
+  std::vector<msgs::Step> slots_;
+  size_t head_;
+  size_t size_;
+  int first_step_index_;
+
+  // transformation applied to the last merged step plan
+  bool stitched_;
+  tf::Transform stitch_transform_;
+
+  // accumulated pose corrections applied lazily to all steps from the given step index on; sorted by step index
+  std::vector<Correction> corrections_;
+
+  // false while further steps are expected to be streamed
+  bool plan_complete_;
+
+  // arena configuration and statistics; statistics are atomics, so they can be read without acquiring any lock
+  bool fixed_capacity_;
+  boost::atomic<size_t> arena_capacity_;
+  boost::atomic<size_t> arena_size_;
+  boost::atomic<size_t> arena_high_water_mark_;
+  boost::atomic<size_t> arena_grow_count_;
+  boost::atomic<size_t> arena_rejected_count_;
+
+  // number of rejected step plans per reason
+  boost::atomic<size_t> reject_counts_[NUM_REJECT_REASONS];
+
+  // tolerance for detecting modified steps during merge
+  Tolerance merge_tolerance_;
+
+  // reusable buffer for merging steps
+  msgs::Step merge_buffer_;
+
+  // content hash of the original step (combined with applied stitch transformation) of each slot
+  std::vector<size_t> slot_hashes_;
+
+  // accumulated step duration up to the end of the step of each slot (prefix sum with arbitrary origin)
+  std::vector<double> slot_end_times_;
+
+  // cached preprocessing result of each slot; valid as long as the slot hash matches
+  mutable std::vector<PreprocessedStep::ConstPtr> slot_results_;
+
+  // plan cache; must be accessed while holding the cache mutex
+  static const size_t VALIDATION_CACHE_SIZE = 8u;
+  std::vector<size_t> plan_step_hashes_;
+  size_t validated_plans_[VALIDATION_CACHE_SIZE];
+  size_t validated_plans_next_;
+
+  // plan cache statistics; atomics, so they can be read without acquiring any lock
+  boost::atomic<size_t> validation_hits_;
+  boost::atomic<size_t> validation_misses_;
+  boost::atomic<size_t> noop_merges_;
+  mutable boost::mutex cache_mutex_; // lock level 3 (see StepControllerPlugin)
+
+  // modification counter
+  boost::atomic<unsigned int> version_;
+
+  // latest snapshot; must be accessed by boost::atomic_load/atomic_store only
+  bool snapshot_enabled_;
+  mutable Snapshot::ConstPtr snapshot_;
+
+  // mutex to ensure thread safeness; innermost lock (level 4), no other lock is acquired while holding it
   mutable boost::shared_mutex queue_mutex_;
 };
+
+std::string toString(const StepQueue::RejectReason& reason);
 }
 
 #endif
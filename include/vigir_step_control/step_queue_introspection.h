@@ -0,0 +1,94 @@
+//=================================================================================================
+// Copyright (c) 2016, Alexander Stumpf, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef VIGIR_STEP_QUEUE_INTROSPECTION_H__
+#define VIGIR_STEP_QUEUE_INTROSPECTION_H__
+
+#include <ros/ros.h>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include <vigir_step_control/StepQueueDelta.h>
+#include <vigir_step_control/step_controller_plugin.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Publishes the content of the step queue as compact delta stream. The publisher runs
+ * in its own low priority thread which also takes the snapshots, so the control loop never pays
+ * for copying the queue. The complete queue is sent again periodically and to new subscribers.
+ */
+class StepQueueIntrospection
+{
+public:
+  // typedefs
+  typedef boost::shared_ptr<StepQueueIntrospection> Ptr;
+  typedef boost::shared_ptr<const StepQueueIntrospection> ConstPtr;
+
+  typedef boost::function<StepControllerSnapshot::ConstPtr()> SnapshotCallback;
+
+  /**
+   * @brief StepQueueIntrospection
+   * @param nh Nodehandle living in correct namespace for all topics
+   * @param get_snapshot Callback returning latest snapshot; must not acquire the controller lock
+   * @param rate Publishing rate [Hz]
+   * @param full_state_period Period [s] after which the complete queue is sent again
+   */
+  StepQueueIntrospection(ros::NodeHandle& nh, SnapshotCallback get_snapshot, double rate, double full_state_period = 10.0);
+  virtual ~StepQueueIntrospection();
+
+protected:
+  void run();
+
+  /**
+   * @brief Generates delta message between last published and given snapshot.
+   * @param snapshot Current snapshot
+   * @param full_state If true, the complete queue is added to the message
+   * @param msg Resulting message
+   */
+  void generateDelta(const StepControllerSnapshot& snapshot, bool full_state, StepQueueDelta& msg) const;
+
+  SnapshotCallback get_snapshot_;
+
+  ros::WallDuration period_;
+  ros::WallDuration full_state_period_;
+
+  StepControllerSnapshot::ConstPtr last_snapshot_;
+
+  // publisher
+  ros::Publisher step_queue_delta_pub_;
+
+  boost::thread thread_;
+};
+}
+
+#endif
@@ -0,0 +1,32 @@
+#include <vigir_step_control/allocation_counter.h>
+
+
+
+namespace vigir_step_control
+{
+namespace
+{
+bool allocation_hook_enabled = false;
+thread_local size_t allocation_count = 0u;
+}
+
+bool AllocationCounter::isEnabled()
+{
+  return allocation_hook_enabled;
+}
+
+size_t AllocationCounter::count()
+{
+  return allocation_count;
+}
+
+void AllocationCounter::enable()
+{
+  allocation_hook_enabled = true;
+}
+
+void AllocationCounter::countAllocation()
+{
+  allocation_count++;
+}
+} // namespace
@@ -0,0 +1,63 @@
+// Replaces the global allocation functions in order to count heap allocations per thread.
+// This file must only be linked into executables for testing purposes (see ALLOCATION_CHECK cmake option).
+
+#include <vigir_step_control/allocation_counter.h>
+
+#include <cstdlib>
+#include <new>
+
+
+
+void* operator new(std::size_t size)
+{
+  vigir_step_control::AllocationCounter::countAllocation();
+
+  void* p = std::malloc(size > 0 ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  vigir_step_control::AllocationCounter::countAllocation();
+  return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+  return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+namespace
+{
+struct AllocationHookEnabler
+{
+  AllocationHookEnabler() { vigir_step_control::AllocationCounter::enable(); }
+} allocation_hook_enabler;
+}
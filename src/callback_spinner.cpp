@@ -0,0 +1,60 @@
+#include <vigir_step_control/callback_spinner.h>
+
+#include <algorithm>
+
+#include <vigir_step_control/thread_utils.h>
+
+
+
+namespace vigir_step_control
+{
+CallbackSpinner::CallbackSpinner(const std::string& name, unsigned int threads, int priority)
+  : name_(name)
+  , threads_(std::max(threads, 1u))
+  , priority_(priority)
+  , running_(false)
+{
+}
+
+CallbackSpinner::~CallbackSpinner()
+{
+  stop();
+}
+
+void CallbackSpinner::start()
+{
+  if (running_)
+    return;
+
+  running_ = true;
+
+  for (unsigned int i = 0; i < threads_; i++)
+  {
+    boost::shared_ptr<boost::thread> thread(new boost::thread(&CallbackSpinner::spin, this));
+
+    if (priority_ != 0)
+      setThreadPriority(*thread, priority_);
+
+    spinner_threads_.push_back(thread);
+  }
+
+  ROS_INFO("[CallbackSpinner] Started %u thread(s) with priority %i for '%s' callbacks.", threads_, priority_, name_.c_str());
+}
+
+void CallbackSpinner::stop()
+{
+  running_ = false;
+
+  for (boost::shared_ptr<boost::thread>& thread : spinner_threads_)
+    thread->join();
+
+  spinner_threads_.clear();
+}
+
+void CallbackSpinner::spin()
+{
+  // timeout bounds the time needed to notice a stop request
+  while (running_ && ros::ok())
+    queue_.callAvailable(ros::WallDuration(0.1));
+}
+} // namespace
@@ -0,0 +1,429 @@
+#include <vigir_step_control/compact_codec.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+
+namespace vigir_step_control
+{
+static const uint8_t COMPACT_STEP_PLAN_FORMAT_VERSION = 1u;
+
+static const uint8_t FEEDBACK_KEY_FRAME = 0x80;
+static const size_t FEEDBACK_INDEX_FIELDS = 6u;
+
+/// writing
+
+static void writeVarint(std::vector<uint8_t>& buffer, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    buffer.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<uint8_t>(value));
+}
+
+static void writeSignedVarint(std::vector<uint8_t>& buffer, int64_t value)
+{
+  // zigzag encoding maps small negative values to small unsigned values
+  writeVarint(buffer, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+static void writeBytes(std::vector<uint8_t>& buffer, const uint8_t* data, size_t size)
+{
+  writeVarint(buffer, size);
+  buffer.insert(buffer.end(), data, data + size);
+}
+
+/// reading
+
+struct Reader
+{
+  Reader(const std::vector<uint8_t>& buffer)
+    : pos(buffer.empty() ? nullptr : &buffer[0])
+    , end(pos + buffer.size())
+  {}
+
+  bool readByte(uint8_t& value)
+  {
+    if (pos >= end)
+      return false;
+    value = *pos++;
+    return true;
+  }
+
+  bool readVarint(uint64_t& value)
+  {
+    value = 0u;
+    for (unsigned int shift = 0; shift < 64; shift += 7)
+    {
+      uint8_t byte;
+      if (!readByte(byte))
+        return false;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  bool readSignedVarint(int64_t& value)
+  {
+    uint64_t raw;
+    if (!readVarint(raw))
+      return false;
+    value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1u);
+    return true;
+  }
+
+  template<typename Container>
+  bool readBytes(Container& data)
+  {
+    uint64_t size;
+    if (!readVarint(size) || size > static_cast<uint64_t>(end - pos))
+      return false;
+    data.assign(pos, pos + size);
+    pos += size;
+    return true;
+  }
+
+  const uint8_t* pos;
+  const uint8_t* end;
+};
+
+/// quantization
+
+static inline int64_t quantize(double value, double resolution)
+{
+  return static_cast<int64_t>(std::llround(value / resolution));
+}
+
+// quantized pose: position x, y, z and orientation x, y, z, w
+typedef int64_t QuantizedPose[7];
+
+static void quantizePose(const geometry_msgs::Pose& pose, const CompactStepPlanCodec::Resolution& resolution, QuantizedPose& q)
+{
+  q[0] = quantize(pose.position.x, resolution.position);
+  q[1] = quantize(pose.position.y, resolution.position);
+  q[2] = quantize(pose.position.z, resolution.position);
+  q[3] = quantize(pose.orientation.x, resolution.orientation);
+  q[4] = quantize(pose.orientation.y, resolution.orientation);
+  q[5] = quantize(pose.orientation.z, resolution.orientation);
+  q[6] = quantize(pose.orientation.w, resolution.orientation);
+}
+
+static void dequantizePose(const QuantizedPose& q, const CompactStepPlanCodec::Resolution& resolution, geometry_msgs::Pose& pose)
+{
+  pose.position.x = static_cast<double>(q[0]) * resolution.position;
+  pose.position.y = static_cast<double>(q[1]) * resolution.position;
+  pose.position.z = static_cast<double>(q[2]) * resolution.position;
+  pose.orientation.x = static_cast<double>(q[3]) * resolution.orientation;
+  pose.orientation.y = static_cast<double>(q[4]) * resolution.orientation;
+  pose.orientation.z = static_cast<double>(q[5]) * resolution.orientation;
+  pose.orientation.w = static_cast<double>(q[6]) * resolution.orientation;
+}
+
+static void writeFoot(std::vector<uint8_t>& buffer, const msgs::Foot& foot, const CompactStepPlanCodec::Resolution& resolution, QuantizedPose& q)
+{
+  buffer.push_back(foot.foot_index);
+  quantizePose(foot.pose, resolution, q);
+  for (size_t i = 0; i < 7; i++)
+    writeSignedVarint(buffer, q[i]);
+}
+
+static bool readFoot(Reader& reader, msgs::Foot& foot, const CompactStepPlanCodec::Resolution& resolution, QuantizedPose& q)
+{
+  if (!reader.readByte(foot.foot_index))
+    return false;
+  for (size_t i = 0; i < 7; i++)
+  {
+    if (!reader.readSignedVarint(q[i]))
+      return false;
+  }
+  dequantizePose(q, resolution, foot.pose);
+  return true;
+}
+
+/// CompactStepPlanCodec
+
+CompactStepPlanCodec::CompactStepPlanCodec(const Resolution& resolution)
+  : resolution_(resolution)
+{
+}
+
+bool CompactStepPlanCodec::encode(const msgs::StepPlan& step_plan, std::vector<uint8_t>& buffer) const
+{
+  for (size_t i = 1; i < step_plan.steps.size(); i++)
+  {
+    if (step_plan.steps[i].step_index != step_plan.steps[i-1].step_index+1)
+    {
+      ROS_ERROR("[CompactStepPlanCodec] encode: Step plan is not continuous (step %i follows step %i)!", step_plan.steps[i].step_index, step_plan.steps[i-1].step_index);
+      return false;
+    }
+  }
+
+  buffer.clear();
+  buffer.push_back(COMPACT_STEP_PLAN_FORMAT_VERSION);
+  writeBytes(buffer, reinterpret_cast<const uint8_t*>(step_plan.header.frame_id.data()), step_plan.header.frame_id.size());
+  buffer.push_back(step_plan.mode);
+  writeSignedVarint(buffer, step_plan.steps.empty() ? 0 : step_plan.steps.front().step_index);
+  writeVarint(buffer, step_plan.steps.size());
+
+  // first step is delta-encoded against the start foot
+  QuantizedPose prev_pose;
+  QuantizedPose goal_pose;
+  writeFoot(buffer, step_plan.start, resolution_, prev_pose);
+  writeFoot(buffer, step_plan.goal, resolution_, goal_pose);
+  writeBytes(buffer, step_plan.data.empty() ? nullptr : &step_plan.data[0], step_plan.data.size());
+
+  int64_t prev_params[5] = { 0, 0, 0, 0, 0 };
+  for (const msgs::Step& step : step_plan.steps)
+  {
+    writeVarint(buffer, (static_cast<uint64_t>(step.foot.foot_index) << 2) | (step.colliding ? 2u : 0u) | (step.valid ? 1u : 0u));
+
+    QuantizedPose pose;
+    quantizePose(step.foot.pose, resolution_, pose);
+    for (size_t i = 0; i < 7; i++)
+    {
+      writeSignedVarint(buffer, pose[i] - prev_pose[i]);
+      prev_pose[i] = pose[i];
+    }
+
+    int64_t params[5] = { quantize(step.step_duration, resolution_.parameter), quantize(step.sway_duration, resolution_.parameter),
+                          quantize(step.swing_height, resolution_.parameter), quantize(step.cost, resolution_.parameter),
+                          quantize(step.risk, resolution_.parameter) };
+    for (size_t i = 0; i < 5; i++)
+    {
+      writeSignedVarint(buffer, params[i] - prev_params[i]);
+      prev_params[i] = params[i];
+    }
+  }
+
+  return true;
+}
+
+bool CompactStepPlanCodec::decode(const std::vector<uint8_t>& buffer, msgs::StepPlan& step_plan) const
+{
+  Reader reader(buffer);
+
+  uint8_t version;
+  int64_t first_step_index;
+  uint64_t step_count;
+  QuantizedPose prev_pose;
+  QuantizedPose goal_pose;
+
+  if (!reader.readByte(version) || version != COMPACT_STEP_PLAN_FORMAT_VERSION ||
+      !reader.readBytes(step_plan.header.frame_id) ||
+      !reader.readByte(step_plan.mode) ||
+      !reader.readSignedVarint(first_step_index) ||
+      !reader.readVarint(step_count) ||
+      !readFoot(reader, step_plan.start, resolution_, prev_pose) ||
+      !readFoot(reader, step_plan.goal, resolution_, goal_pose) ||
+      !reader.readBytes(step_plan.data))
+  {
+    ROS_ERROR("[CompactStepPlanCodec] decode: Corrupted step plan header!");
+    return false;
+  }
+
+  // each step is encoded by at least 13 bytes
+  if (step_count > static_cast<uint64_t>(reader.end - reader.pos) / 13u)
+  {
+    ROS_ERROR("[CompactStepPlanCodec] decode: Invalid step count (%lu)!", static_cast<unsigned long>(step_count));
+    return false;
+  }
+
+  step_plan.header.stamp = ros::Time::now();
+  step_plan.start.header = step_plan.header;
+  step_plan.goal.header = step_plan.header;
+
+  int64_t prev_params[5] = { 0, 0, 0, 0, 0 };
+
+  // resize keeps memory of steps already owned by the step plan
+  step_plan.steps.resize(static_cast<size_t>(step_count));
+  for (size_t s = 0; s < step_plan.steps.size(); s++)
+  {
+    msgs::Step& step = step_plan.steps[s];
+
+    uint64_t flags;
+    if (!reader.readVarint(flags))
+    {
+      ROS_ERROR("[CompactStepPlanCodec] decode: Corrupted step %lu!", s);
+      return false;
+    }
+
+    for (size_t i = 0; i < 7; i++)
+    {
+      int64_t delta;
+      if (!reader.readSignedVarint(delta))
+      {
+        ROS_ERROR("[CompactStepPlanCodec] decode: Corrupted step %lu!", s);
+        return false;
+      }
+      prev_pose[i] += delta;
+    }
+
+    for (size_t i = 0; i < 5; i++)
+    {
+      int64_t delta;
+      if (!reader.readSignedVarint(delta))
+      {
+        ROS_ERROR("[CompactStepPlanCodec] decode: Corrupted step %lu!", s);
+        return false;
+      }
+      prev_params[i] += delta;
+    }
+
+    step.header = step_plan.header;
+    step.step_index = static_cast<int>(first_step_index) + static_cast<int>(s);
+    step.foot.header = step_plan.header;
+    step.foot.foot_index = static_cast<uint8_t>(flags >> 2);
+    step.valid = (flags & 1u) != 0u;
+    step.colliding = (flags & 2u) != 0u;
+    dequantizePose(prev_pose, resolution_, step.foot.pose);
+    step.step_duration = static_cast<double>(prev_params[0]) * resolution_.parameter;
+    step.sway_duration = static_cast<double>(prev_params[1]) * resolution_.parameter;
+    step.swing_height = static_cast<double>(prev_params[2]) * resolution_.parameter;
+    step.cost = static_cast<double>(prev_params[3]) * resolution_.parameter;
+    step.risk = static_cast<double>(prev_params[4]) * resolution_.parameter;
+  }
+
+  return true;
+}
+
+/// feedback
+
+static void getIndexFields(const msgs::ExecuteStepPlanFeedback& feedback, int32_t (&fields)[FEEDBACK_INDEX_FIELDS])
+{
+  fields[0] = feedback.last_performed_step_index;
+  fields[1] = feedback.currently_executing_step_index;
+  fields[2] = feedback.first_changeable_step_index;
+  fields[3] = feedback.queue_size;
+  fields[4] = feedback.first_queued_step_index;
+  fields[5] = feedback.last_queued_step_index;
+}
+
+static void setIndexFields(msgs::ExecuteStepPlanFeedback& feedback, const int32_t (&fields)[FEEDBACK_INDEX_FIELDS])
+{
+  feedback.last_performed_step_index = fields[0];
+  feedback.currently_executing_step_index = fields[1];
+  feedback.first_changeable_step_index = fields[2];
+  feedback.queue_size = fields[3];
+  feedback.first_queued_step_index = fields[4];
+  feedback.last_queued_step_index = fields[5];
+}
+
+CompactFeedbackEncoder::CompactFeedbackEncoder(unsigned int key_frame_interval)
+  : key_frame_interval_(std::max(key_frame_interval, 1u))
+  , messages_since_key_frame_(0u)
+  , seq_(0u)
+  , has_previous_(false)
+{
+}
+
+void CompactFeedbackEncoder::encode(const msgs::ExecuteStepPlanFeedback& feedback, std::vector<uint8_t>& buffer)
+{
+  bool key_frame = !has_previous_ || messages_since_key_frame_ + 1 >= key_frame_interval_;
+
+  int32_t fields[FEEDBACK_INDEX_FIELDS];
+  int32_t previous_fields[FEEDBACK_INDEX_FIELDS];
+  getIndexFields(feedback, fields);
+  getIndexFields(previous_, previous_fields);
+
+  // key frames are encoded as deltas against zero
+  if (key_frame)
+  {
+    for (size_t i = 0; i < FEEDBACK_INDEX_FIELDS; i++)
+      previous_fields[i] = 0;
+  }
+
+  // bit 0: controller state; bit i+1: index field i
+  uint8_t changed = 0u;
+  if (key_frame || feedback.controller_state != previous_.controller_state)
+    changed |= 1u;
+  for (size_t i = 0; i < FEEDBACK_INDEX_FIELDS; i++)
+  {
+    if (key_frame || fields[i] != previous_fields[i])
+      changed |= static_cast<uint8_t>(1u << (i+1));
+  }
+
+  buffer.clear();
+  buffer.push_back(key_frame ? FEEDBACK_KEY_FRAME : 0u);
+  buffer.push_back(++seq_);
+  buffer.push_back(changed);
+
+  if (changed & 1u)
+    buffer.push_back(feedback.controller_state);
+  for (size_t i = 0; i < FEEDBACK_INDEX_FIELDS; i++)
+  {
+    if (changed & (1u << (i+1)))
+      writeSignedVarint(buffer, static_cast<int64_t>(fields[i]) - static_cast<int64_t>(previous_fields[i]));
+  }
+
+  previous_ = feedback;
+  has_previous_ = true;
+  messages_since_key_frame_ = key_frame ? 0u : messages_since_key_frame_ + 1;
+}
+
+void CompactFeedbackEncoder::reset()
+{
+  has_previous_ = false;
+}
+
+CompactFeedbackDecoder::CompactFeedbackDecoder()
+  : synchronized_(false)
+  , seq_(0u)
+{
+}
+
+bool CompactFeedbackDecoder::decode(const std::vector<uint8_t>& buffer, msgs::ExecuteStepPlanFeedback& feedback)
+{
+  Reader reader(buffer);
+
+  uint8_t type, seq, changed;
+  if (!reader.readByte(type) || !reader.readByte(seq) || !reader.readByte(changed))
+    return false;
+
+  bool key_frame = (type & FEEDBACK_KEY_FRAME) != 0u;
+
+  // deltas can only be applied on top of the previous message
+  if (!key_frame && (!synchronized_ || seq != static_cast<uint8_t>(seq_ + 1)))
+  {
+    synchronized_ = false;
+    return false;
+  }
+
+  msgs::ExecuteStepPlanFeedback decoded = key_frame ? msgs::ExecuteStepPlanFeedback() : current_;
+
+  int32_t fields[FEEDBACK_INDEX_FIELDS];
+  getIndexFields(decoded, fields);
+  if (key_frame)
+  {
+    for (size_t i = 0; i < FEEDBACK_INDEX_FIELDS; i++)
+      fields[i] = 0;
+  }
+
+  if ((changed & 1u) && !reader.readByte(decoded.controller_state))
+    return false;
+
+  for (size_t i = 0; i < FEEDBACK_INDEX_FIELDS; i++)
+  {
+    if (!(changed & (1u << (i+1))))
+      continue;
+
+    int64_t delta;
+    if (!reader.readSignedVarint(delta))
+      return false;
+    fields[i] = static_cast<int32_t>(fields[i] + delta);
+  }
+
+  setIndexFields(decoded, fields);
+
+  current_ = decoded;
+  seq_ = seq;
+  synchronized_ = true;
+
+  feedback = current_;
+  return true;
+}
+} // namespace
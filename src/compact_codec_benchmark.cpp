@@ -0,0 +1,125 @@
+#include <ros/ros.h>
+#include <ros/serialization.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <tf/tf.h>
+
+#include <vigir_step_control/compact_codec.h>
+
+
+
+namespace vigir_step_control
+{
+namespace ser = ros::serialization;
+
+/**
+ * @brief Generates a step plan walking along a slight curve.
+ * @param steps Number of steps
+ * @param step_plan [out] Step plan
+ */
+static void generateStepPlan(size_t steps, msgs::StepPlan& step_plan)
+{
+  step_plan.header.frame_id = "world";
+  step_plan.start.foot_index = msgs::Foot::LEFT;
+  step_plan.start.pose.orientation.w = 1.0;
+  step_plan.goal = step_plan.start;
+
+  step_plan.steps.resize(steps);
+  for (size_t i = 0; i < steps; i++)
+  {
+    msgs::Step& step = step_plan.steps[i];
+    double yaw = 0.01 * static_cast<double>(i);
+
+    step.header.frame_id = step_plan.header.frame_id;
+    step.step_index = static_cast<int>(i);
+    step.foot.foot_index = i % 2 == 0 ? msgs::Foot::RIGHT : msgs::Foot::LEFT;
+    step.foot.pose.position.x = 0.25 * static_cast<double>(i) * std::cos(yaw);
+    step.foot.pose.position.y = 0.25 * static_cast<double>(i) * std::sin(yaw) + (i % 2 == 0 ? -0.1 : 0.1);
+    tf::quaternionTFToMsg(tf::createQuaternionFromYaw(yaw), step.foot.pose.orientation);
+    step.step_duration = 0.7;
+    step.sway_duration = 0.1;
+    step.swing_height = 0.1;
+    step.valid = true;
+    step.cost = 1.0 + 0.001 * static_cast<double>(i);
+  }
+
+  step_plan.goal = step_plan.steps.back().foot;
+}
+
+template<typename Function>
+static double measure(Function function, size_t iterations)
+{
+  ros::WallTime start = ros::WallTime::now();
+  for (size_t i = 0; i < iterations; i++)
+    function();
+  return (ros::WallTime::now() - start).toSec() / static_cast<double>(iterations);
+}
+
+static void benchmarkStepPlan(size_t steps, size_t iterations)
+{
+  msgs::StepPlan step_plan;
+  generateStepPlan(steps, step_plan);
+
+  CompactStepPlanCodec codec;
+
+  std::vector<uint8_t> ros_buffer(ser::serializationLength(step_plan));
+  std::vector<uint8_t> compact_buffer;
+  msgs::StepPlan decoded;
+
+  double ros_encode = measure([&]() { ser::OStream stream(&ros_buffer[0], static_cast<uint32_t>(ros_buffer.size())); ser::serialize(stream, step_plan); }, iterations);
+  double compact_encode = measure([&]() { codec.encode(step_plan, compact_buffer); }, iterations);
+  double compact_decode = measure([&]() { codec.decode(compact_buffer, decoded); }, iterations);
+
+  printf("step plan (%4lu steps): ros %8.1f bytes/step %8.2f us/step | compact %6.1f bytes/step %6.2f us/step encode %6.2f us/step decode\n", steps,
+         static_cast<double>(ros_buffer.size()) / static_cast<double>(steps), ros_encode * 1e6 / static_cast<double>(steps),
+         static_cast<double>(compact_buffer.size()) / static_cast<double>(steps), compact_encode * 1e6 / static_cast<double>(steps),
+         compact_decode * 1e6 / static_cast<double>(steps));
+}
+
+static void benchmarkFeedback(size_t iterations)
+{
+  msgs::ExecuteStepPlanFeedback feedback;
+  feedback.controller_state = msgs::ExecuteStepPlanFeedback::ACTIVE;
+  feedback.first_queued_step_index = 0;
+  feedback.last_queued_step_index = 1000;
+
+  CompactFeedbackEncoder encoder;
+  std::vector<uint8_t> buffer;
+
+  size_t ros_bytes = 0u;
+  size_t compact_bytes = 0u;
+
+  // walking engine advances by one step per feedback message
+  double compact_encode = measure([&]() {
+    feedback.last_performed_step_index++;
+    feedback.currently_executing_step_index = feedback.last_performed_step_index + 1;
+    feedback.first_changeable_step_index = feedback.last_performed_step_index + 3;
+    feedback.queue_size = feedback.last_queued_step_index - feedback.last_performed_step_index;
+    encoder.encode(feedback, buffer);
+    ros_bytes += ser::serializationLength(feedback);
+    compact_bytes += buffer.size();
+  }, iterations);
+
+  printf("feedback: ros %6.1f bytes/msg | compact %6.1f bytes/msg %6.3f us/msg encode\n",
+         static_cast<double>(ros_bytes) / static_cast<double>(iterations),
+         static_cast<double>(compact_bytes) / static_cast<double>(iterations), compact_encode * 1e6);
+}
+}
+
+int main(int argc, char **argv)
+{
+  ros::Time::init();
+
+  size_t iterations = argc > 1 ? static_cast<size_t>(std::max(atoi(argv[1]), 1)) : 100u;
+
+  vigir_step_control::benchmarkStepPlan(10u, iterations);
+  vigir_step_control::benchmarkStepPlan(100u, iterations);
+  vigir_step_control::benchmarkStepPlan(1000u, iterations);
+  vigir_step_control::benchmarkFeedback(iterations * 100u);
+
+  return 0;
+}
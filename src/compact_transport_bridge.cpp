@@ -0,0 +1,73 @@
+#include <ros/ros.h>
+
+#include <vigir_step_control/CompactFeedback.h>
+#include <vigir_step_control/CompactStepPlan.h>
+#include <vigir_step_control/compact_codec.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Remote side of the compact transport: Encodes step plans sent to the step controller and
+ * decodes its feedback, so operator tools can use the regular topics over a constrained link.
+ */
+class CompactTransportBridge
+{
+public:
+  CompactTransportBridge(ros::NodeHandle& nh)
+    : codec_(CompactStepPlanCodec::Resolution(nh.param("compact_position_resolution", 1e-4),
+                                              nh.param("compact_orientation_resolution", 1e-6),
+                                              nh.param("compact_parameter_resolution", 1e-4)))
+  {
+    execute_step_plan_sub_ = nh.subscribe("execute_step_plan", 1, &CompactTransportBridge::executeStepPlan, this);
+    compact_feedback_sub_ = nh.subscribe("execute_feedback_compact", 10, &CompactTransportBridge::compactFeedback, this);
+
+    compact_step_plan_pub_ = nh.advertise<CompactStepPlan>("execute_step_plan_compact", 1);
+    feedback_pub_ = nh.advertise<msgs::ExecuteStepPlanFeedback>("execute_feedback", 1, true);
+  }
+
+protected:
+  void executeStepPlan(const msgs::StepPlanConstPtr& step_plan)
+  {
+    CompactStepPlan msg;
+    if (codec_.encode(*step_plan, msg.data))
+      compact_step_plan_pub_.publish(msg);
+  }
+
+  void compactFeedback(const CompactFeedbackConstPtr& compact_feedback)
+  {
+    msgs::ExecuteStepPlanFeedback feedback;
+    if (feedback_decoder_.decode(compact_feedback->data, feedback))
+      feedback_pub_.publish(feedback);
+    else
+      ROS_WARN_THROTTLE(1.0, "[CompactTransportBridge] Feedback dropped while waiting for next key frame.");
+  }
+
+  CompactStepPlanCodec codec_;
+  CompactFeedbackDecoder feedback_decoder_;
+
+  ros::Subscriber execute_step_plan_sub_;
+  ros::Subscriber compact_feedback_sub_;
+
+  ros::Publisher compact_step_plan_pub_;
+  ros::Publisher feedback_pub_;
+};
+}
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "compact_transport_bridge");
+
+  ros::NodeHandle nh;
+
+  // ensure that node's services are set up in proper namespace
+  if (nh.getNamespace().size() <= 1)
+    nh = ros::NodeHandle("~");
+
+  vigir_step_control::CompactTransportBridge bridge(nh);
+
+  ros::spin();
+
+  return 0;
+}
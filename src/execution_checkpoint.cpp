@@ -0,0 +1,297 @@
+#include <vigir_step_control/execution_checkpoint.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
+
+#include <ros/serialization.h>
+
+#include <vigir_step_control/thread_utils.h>
+
+
+
+namespace vigir_step_control
+{
+namespace ser = ros::serialization;
+
+static const uint32_t CHECKPOINT_MAGIC = 0x53545043; // "STPC"
+static const uint32_t CHECKPOINT_FORMAT_VERSION = 1u;
+
+static uint32_t computeChecksum(const uint8_t* data, size_t size)
+{
+  boost::crc_32_type crc;
+  crc.process_bytes(data, size);
+  return crc.checksum();
+}
+
+static size_t alignToPageSize(size_t size)
+{
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+ExecutionCheckpoint::ExecutionCheckpoint(const std::string& file_name, size_t max_size)
+  : file_name_(file_name)
+  , slot_size_(alignToPageSize(sizeof(SlotHeader) + max_size))
+  , fd_(-1)
+  , data_(nullptr)
+  , sequence_(0u)
+  , next_slot_(0u)
+{
+  fd_ = open(file_name_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0)
+  {
+    ROS_ERROR("[ExecutionCheckpoint] Could not open checkpoint file '%s'!", file_name_.c_str());
+    return;
+  }
+
+  if (ftruncate(fd_, static_cast<off_t>(2 * slot_size_)) != 0)
+  {
+    ROS_ERROR("[ExecutionCheckpoint] Could not resize checkpoint file '%s'!", file_name_.c_str());
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  void* data = mmap(nullptr, 2 * slot_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED)
+  {
+    ROS_ERROR("[ExecutionCheckpoint] Could not map checkpoint file '%s'!", file_name_.c_str());
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  data_ = static_cast<uint8_t*>(data);
+
+  // continue after latest checkpoint
+  int slot = latestValidSlot();
+  if (slot >= 0)
+  {
+    sequence_ = slotHeader(static_cast<size_t>(slot))->sequence;
+    next_slot_ = static_cast<size_t>(1 - slot);
+  }
+}
+
+ExecutionCheckpoint::~ExecutionCheckpoint()
+{
+  stop();
+
+  if (data_)
+  {
+    msync(data_, 2 * slot_size_, MS_SYNC);
+    munmap(data_, 2 * slot_size_);
+  }
+
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+bool ExecutionCheckpoint::isOpen() const
+{
+  return data_ != nullptr;
+}
+
+bool ExecutionCheckpoint::read(StepControllerSnapshot& checkpoint, const ros::WallDuration& max_age) const
+{
+  if (!isOpen())
+    return false;
+
+  int slot = latestValidSlot();
+  if (slot < 0)
+    return false;
+
+  const SlotHeader* header = slotHeader(static_cast<size_t>(slot));
+
+  ros::WallDuration age = ros::WallTime::now() - ros::WallTime().fromNSec(static_cast<uint64_t>(header->stamp));
+  if (age > max_age)
+  {
+    ROS_INFO("[ExecutionCheckpoint] Ignoring outdated checkpoint (age: %.1f s).", age.toSec());
+    return false;
+  }
+
+  boost::shared_ptr<StepQueue::Snapshot> queue(new StepQueue::Snapshot());
+  queue->version = 0u;
+
+  int32_t state;
+  uint8_t plan_complete;
+
+  try
+  {
+    ser::IStream stream(slotPayload(static_cast<size_t>(slot)), header->payload_size);
+    ser::deserialize(stream, state);
+    ser::deserialize(stream, checkpoint.next_step_index_needed);
+    ser::deserialize(stream, checkpoint.last_step_index_sent);
+    ser::deserialize(stream, plan_complete);
+    ser::deserialize(stream, checkpoint.feedback);
+    ser::deserialize(stream, queue->steps);
+  }
+  catch (ser::StreamOverrunException& e)
+  {
+    ROS_ERROR("[ExecutionCheckpoint] Corrupted checkpoint: %s", e.what());
+    return false;
+  }
+
+  queue->plan_complete = plan_complete != 0u;
+
+  checkpoint.state = static_cast<StepControllerState>(state);
+  checkpoint.replan_invalidated_steps = 0;
+  checkpoint.queue = queue;
+
+  return true;
+}
+
+bool ExecutionCheckpoint::write(const StepControllerSnapshot& snapshot)
+{
+  if (!isOpen() || !snapshot.queue)
+    return false;
+
+  int32_t state = snapshot.state;
+  uint8_t plan_complete = snapshot.queue->plan_complete ? 1u : 0u;
+
+  uint32_t payload_size = ser::serializationLength(state) +
+                          ser::serializationLength(snapshot.next_step_index_needed) +
+                          ser::serializationLength(snapshot.last_step_index_sent) +
+                          ser::serializationLength(plan_complete) +
+                          ser::serializationLength(snapshot.feedback) +
+                          ser::serializationLength(snapshot.queue->steps);
+
+  if (payload_size > slot_size_ - sizeof(SlotHeader))
+  {
+    ROS_ERROR_THROTTLE(5.0, "[ExecutionCheckpoint] Checkpoint size (%u) exceeds maximal size (%lu)!", payload_size, slot_size_ - sizeof(SlotHeader));
+    return false;
+  }
+
+  SlotHeader* header = slotHeader(next_slot_);
+  uint8_t* payload = slotPayload(next_slot_);
+
+  // invalidate slot while writing
+  header->magic = 0u;
+
+  ser::OStream stream(payload, payload_size);
+  ser::serialize(stream, state);
+  ser::serialize(stream, snapshot.next_step_index_needed);
+  ser::serialize(stream, snapshot.last_step_index_sent);
+  ser::serialize(stream, plan_complete);
+  ser::serialize(stream, snapshot.feedback);
+  ser::serialize(stream, snapshot.queue->steps);
+
+  header->format_version = CHECKPOINT_FORMAT_VERSION;
+  header->sequence = ++sequence_;
+  header->stamp = static_cast<int64_t>(ros::WallTime::now().toNSec());
+  header->payload_size = payload_size;
+  header->checksum = computeChecksum(payload, payload_size);
+  __sync_synchronize();
+  header->magic = CHECKPOINT_MAGIC;
+
+  // the mapping survives crashes of the process; flushing to disk is left to the kernel
+  msync(data_ + next_slot_ * slot_size_, sizeof(SlotHeader) + payload_size, MS_ASYNC);
+
+  next_slot_ = 1u - next_slot_;
+
+  return true;
+}
+
+void ExecutionCheckpoint::start(SnapshotCallback get_snapshot, double rate)
+{
+  if (!isOpen() || thread_.joinable())
+    return;
+
+  get_snapshot_ = get_snapshot;
+  period_ = ros::WallDuration(1.0/rate);
+
+  thread_ = boost::thread(&ExecutionCheckpoint::run, this);
+
+  // checkpointing must never compete with the control loop
+  setThreadPriority(thread_, -1);
+}
+
+void ExecutionCheckpoint::stop()
+{
+  thread_.interrupt();
+  thread_.join();
+}
+
+void ExecutionCheckpoint::clear()
+{
+  if (!isOpen())
+    return;
+
+  for (size_t slot = 0; slot < 2; slot++)
+    slotHeader(slot)->magic = 0u;
+
+  msync(data_, 2 * slot_size_, MS_ASYNC);
+}
+
+void ExecutionCheckpoint::run()
+{
+  StepControllerSnapshot::ConstPtr last_snapshot;
+  ros::WallTime last_write;
+
+  try
+  {
+    while (ros::ok())
+    {
+      boost::this_thread::sleep(boost::posix_time::microseconds(period_.toNSec() / 1000));
+
+      StepControllerSnapshot::ConstPtr snapshot = get_snapshot_();
+      if (!snapshot)
+        continue;
+
+      // nothing to be continued once the execution has ended (e.g. controller is READY again)
+      if (snapshot->state != ACTIVE && snapshot->state != PAUSED)
+      {
+        if (snapshot != last_snapshot)
+          clear();
+        last_snapshot = snapshot;
+        continue;
+      }
+
+      // refresh unchanged checkpoints once per second, so they don't become outdated
+      ros::WallTime now = ros::WallTime::now();
+      if (snapshot == last_snapshot && (now - last_write) < ros::WallDuration(1.0))
+        continue;
+
+      if (write(*snapshot))
+      {
+        last_snapshot = snapshot;
+        last_write = now;
+      }
+    }
+  }
+  catch (boost::thread_interrupted&)
+  {
+  }
+}
+
+ExecutionCheckpoint::SlotHeader* ExecutionCheckpoint::slotHeader(size_t slot) const
+{
+  return reinterpret_cast<SlotHeader*>(data_ + slot * slot_size_);
+}
+
+uint8_t* ExecutionCheckpoint::slotPayload(size_t slot) const
+{
+  return data_ + slot * slot_size_ + sizeof(SlotHeader);
+}
+
+int ExecutionCheckpoint::latestValidSlot() const
+{
+  int latest = -1;
+
+  for (size_t slot = 0; slot < 2; slot++)
+  {
+    const SlotHeader* header = slotHeader(slot);
+    if (header->magic != CHECKPOINT_MAGIC || header->format_version != CHECKPOINT_FORMAT_VERSION ||
+        header->payload_size > slot_size_ - sizeof(SlotHeader) ||
+        header->checksum != computeChecksum(slotPayload(slot), header->payload_size))
+      continue;
+
+    if (latest < 0 || header->sequence > slotHeader(static_cast<size_t>(latest))->sequence)
+      latest = static_cast<int>(slot);
+  }
+
+  return latest;
+}
+} // namespace
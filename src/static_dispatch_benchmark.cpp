@@ -0,0 +1,160 @@
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <vigir_step_control/static_step_controller_plugin.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Minimal plugin whose walking engine needs a further step in each cycle, so every cycle
+ * dispatches preProcess, process, executeStep and postProcess without doing any real work.
+ */
+class DispatchBenchmarkPlugin
+  : public StaticStepControllerPlugin<DispatchBenchmarkPlugin>
+{
+public:
+  DispatchBenchmarkPlugin()
+    : StaticStepControllerPlugin<DispatchBenchmarkPlugin>()
+    , executed_steps_(0u)
+  {}
+
+  void initWalk() override
+  {
+    setNextStepIndexNeeded(-1);
+    setState(ACTIVE);
+  }
+
+  void preProcess(const ros::TimerEvent& event) override
+  {
+    StepControllerPlugin::preProcess(event);
+
+    if (getState() == ACTIVE && getNextStepIndexNeeded() < step_queue_->lastStepIndex())
+      setNextStepIndexNeeded(getNextStepIndexNeeded()+1);
+  }
+
+  bool executeStep(const msgs::Step& step) override
+  {
+    executed_steps_++;
+    return step.step_index >= 0;
+  }
+
+  /**
+   * @brief Starts a new execution of the given step plan.
+   * @param step_plan Step plan to be executed
+   */
+  void restart(const msgs::StepPlan& step_plan)
+  {
+    reset();
+    updateStepPlan(step_plan);
+  }
+
+  size_t getExecutedSteps() const { return executed_steps_; }
+
+protected:
+  size_t executed_steps_;
+};
+
+/**
+ * @brief Generates a straight step plan.
+ * @param steps Number of steps
+ * @param step_plan [out] Step plan
+ */
+static void generateStepPlan(size_t steps, msgs::StepPlan& step_plan)
+{
+  step_plan.header.frame_id = "world";
+  step_plan.steps.resize(steps);
+  for (size_t i = 0; i < steps; i++)
+  {
+    msgs::Step& step = step_plan.steps[i];
+    step.header.frame_id = step_plan.header.frame_id;
+    step.step_index = static_cast<int>(i);
+    step.foot.foot_index = i % 2 == 0 ? msgs::Foot::RIGHT : msgs::Foot::LEFT;
+    step.foot.pose.position.x = 0.25 * static_cast<double>(i);
+    step.foot.pose.position.y = i % 2 == 0 ? -0.1 : 0.1;
+    step.foot.pose.orientation.w = 1.0;
+    step.step_duration = 0.7;
+    step.valid = true;
+  }
+}
+
+// prevents the compiler from resolving the virtual calls at compile time
+static StepControllerPlugin::Ptr __attribute__((noinline)) createPlugin()
+{
+  return StepControllerPlugin::Ptr(new DispatchBenchmarkPlugin());
+}
+
+/**
+ * @brief Measures the average time of an update cycle. Each round executes the complete step plan,
+ * while restarting the execution is not measured.
+ * @param plugin Plugin executing the step plan
+ * @param step_plan Step plan executed in each round
+ * @param cycle Callable running a single update cycle
+ * @param rounds Number of rounds
+ * @return Average time [s] per cycle
+ */
+template<typename Cycle>
+static double measure(DispatchBenchmarkPlugin& plugin, const msgs::StepPlan& step_plan, Cycle cycle, size_t rounds)
+{
+  ros::TimerEvent event;
+  double duration = 0.0;
+  size_t cycles = 0u;
+
+  for (size_t r = 0; r < rounds; r++)
+  {
+    plugin.restart(step_plan);
+
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t i = 0; i < step_plan.steps.size(); i++)
+      cycle(event);
+    duration += (ros::WallTime::now() - start).toSec();
+
+    cycles += step_plan.steps.size();
+  }
+
+  return duration / static_cast<double>(cycles);
+}
+
+static void benchmarkDispatch(size_t steps, size_t rounds)
+{
+  msgs::StepPlan step_plan;
+  generateStepPlan(steps, step_plan);
+
+  // virtual dispatch as done by StepController
+  StepControllerPlugin::Ptr plugin = createPlugin();
+  double virtual_cycle = measure(static_cast<DispatchBenchmarkPlugin&>(*plugin), step_plan, [&](const ros::TimerEvent& event) {
+    plugin->preProcess(event);
+    plugin->process(event);
+    plugin->postProcess(event);
+  }, rounds);
+
+  // static dispatch as done by StaticStepController
+  StaticStepController<DispatchBenchmarkPlugin> controller;
+  double static_cycle = measure(controller.plugin(), step_plan, [&](const ros::TimerEvent& event) {
+    controller.update(event);
+  }, rounds);
+
+  size_t virtual_steps = static_cast<DispatchBenchmarkPlugin&>(*plugin).getExecutedSteps();
+  size_t static_steps = controller.plugin().getExecutedSteps();
+
+  printf("update cycle (%4lu steps): virtual %8.1f ns/cycle | static %8.1f ns/cycle | speedup %5.2f (executed steps: %lu/%lu)\n", steps,
+         virtual_cycle * 1e9, static_cycle * 1e9, static_cycle > 0.0 ? virtual_cycle / static_cycle : 0.0, virtual_steps, static_steps);
+}
+}
+
+int main(int argc, char **argv)
+{
+  ros::Time::init();
+
+  size_t rounds = argc > 1 ? static_cast<size_t>(std::max(atoi(argv[1]), 1)) : 100u;
+
+  vigir_step_control::benchmarkDispatch(10u, rounds * 100u);
+  vigir_step_control::benchmarkDispatch(100u, rounds * 10u);
+  vigir_step_control::benchmarkDispatch(1000u, rounds);
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include <vigir_step_control/step_control_log.h>
+
+#include <vigir_step_control/thread_utils.h>
+
+
+
+namespace vigir_step_control
+{
+LogRing& LogRing::instance()
+{
+  static LogRing log_ring;
+  return log_ring;
+}
+
+LogRing::LogRing()
+  : dropped_(0u)
+  , reported_dropped_(0u)
+  , running_(true)
+{
+  thread_ = boost::thread(&LogRing::run, this);
+
+  // logging must never compete with the control loop
+  setThreadPriority(thread_, -1);
+}
+
+LogRing::~LogRing()
+{
+  running_ = false;
+  thread_.join();
+
+  // print remaining events
+  flush();
+  retired_.clear();
+}
+
+void LogRing::releaseAfterFlush(boost::shared_ptr<void> object)
+{
+  boost::unique_lock<boost::mutex> lock(retired_mutex_);
+  retired_.push_back(object);
+}
+
+void LogRing::run()
+{
+  std::vector<boost::shared_ptr<void>> retired;
+
+  while (running_)
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(retired_mutex_);
+      retired.swap(retired_);
+    }
+
+    size_t count = flush();
+
+    // flush has drained the ring, so all events enqueued before these objects were retired have been output
+    retired.clear();
+
+    if (count == 0u)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  }
+}
+
+size_t LogRing::flush()
+{
+  boost::unique_lock<boost::mutex> lock(flush_mutex_);
+
+  char buffer[1024];
+  size_t count = 0u;
+
+  LogEvent event;
+  while (ring_.pop(event))
+  {
+    event.formatter(event, buffer, sizeof(buffer));
+
+    if (event.suppressed > 0u)
+      ROS_LOG(event.site->level, ROSCONSOLE_DEFAULT_NAME, "%s (%u similar message(s) suppressed)", buffer, event.suppressed);
+    else
+      ROS_LOG(event.site->level, ROSCONSOLE_DEFAULT_NAME, "%s", buffer);
+
+    count++;
+  }
+
+  size_t dropped = dropped_.load(boost::memory_order_relaxed);
+  if (dropped != reported_dropped_)
+  {
+    ROS_WARN("[LogRing] %lu log message(s) dropped due to full log ring.", dropped - reported_dropped_);
+    reported_dropped_ = dropped;
+  }
+
+  return count;
+}
+} // namespace
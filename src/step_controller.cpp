@@ -1,34 +1,191 @@
 #include <vigir_step_control/step_controller.h>
 
+#include <limits>
+
 #include <vigir_generic_params/parameter_manager.h>
 
+#include <vigir_step_control/allocation_counter.h>
+#include <vigir_step_control/thread_utils.h>
+
 
 
 namespace vigir_step_control
 {
 StepController::StepController(ros::NodeHandle& nh, bool auto_spin)
+  : streaming_(false)
+  , stream_plan_id_(0u)
+  , stream_next_seq_(0u)
+  , coalesced_plans_(0u)
+  , merged_plans_(0u)
+  , rejected_plans_(0u)
+  , step_index_offset_(0)
+  , plan_file_next_step_index_(-1)
+  , last_published_feedback_version_(0u)
+  , last_published_timeline_feedback_version_(0u)
+  , last_published_timeline_queue_version_(0u)
+  , steady_state_allocations_(0u)
+  , invariant_violations_(0u)
+  , plugin_swap_pending_(false)
+  , emergency_stop_pending_(false)
+  , plugin_loader_shutdown_(false)
 {
+  ros::WallTime startup_start = ros::WallTime::now();
+
+  check_allocations_ = nh.param("check_allocations", false);
+  if (check_allocations_ && !AllocationCounter::isEnabled())
+  {
+    ROS_WARN("[StepController] Allocation check requested but allocation hook is not available. Rebuild with ALLOCATION_CHECK enabled.");
+    check_allocations_ = false;
+  }
+
+  check_invariants_ = nh.param("check_invariants", false);
+
+  // republishing unchanged feedback serializes it in each cycle, so steady state cycles can't be allocation free
+  feedback_on_change_only_ = nh.param("feedback_on_change_only", check_allocations_);
+  if (check_allocations_ && !feedback_on_change_only_)
+    ROS_WARN("[StepController] Feedback is published in each cycle, so steady state cycles will report its allocations. Enable feedback_on_change_only for allocation free steady state cycles.");
+
+  // step queue memory configuration
+  queue_capacity_ = nh.param("queue_capacity", 0);
+  queue_fixed_capacity_ = nh.param("queue_fixed_capacity", false);
+
+  // asynchronous step execution
+  async_execution_ = nh.param("async_execution", false);
+  async_execution_timeout_ = nh.param("async_execution_timeout", 1.0);
+  max_steps_in_flight_ = nh.param("max_steps_in_flight", 1);
+
+  // only steps modified beyond these tolerances are re-sent on step plan updates
+  replan_tolerance_.position = nh.param("replan_position_tolerance", 0.0);
+  replan_tolerance_.orientation = nh.param("replan_orientation_tolerance", 0.0);
+  replan_tolerance_.parameter = nh.param("replan_parameter_tolerance", 0.0);
+
+  // timing scheduler
+  deadline_scheduling_ = nh.param("deadline_scheduling", false);
+  deadline_safety_margin_ = nh.param("deadline_safety_margin", 0.1);
+
+  // backpressure: step plans are coalesced while merging is throttled by the merge rate budget
+  max_queue_size_ = nh.param("max_queue_size", 0);
+  double max_merge_rate = nh.param("max_merge_rate", 0.0);
+  if (max_merge_rate > 0.0)
+    min_merge_interval_ = ros::WallDuration(1.0 / max_merge_rate);
+
+  // continuous walking; step indices are rebased as soon as the given step has been performed
+  continuous_mode_ = nh.param("continuous_mode", false);
+  rebase_step_index_ = nh.param("rebase_step_index", 10000);
+
+  // time without any chunk after which a stream is completed with the steps received so far; 0 disables
+  stream_timeout_ = ros::WallDuration(std::max(nh.param("stream_timeout", 5.0), 0.0));
+
+  // number of steps of step plan files enqueued ahead of the walking engine
+  plan_file_lookahead_ = std::max(nh.param("plan_file_lookahead", 50), 1);
+
+  // compact transport
+  compact_transport_ = nh.param("compact_transport", false);
+  if (compact_transport_)
+  {
+    compact_step_plan_codec_.reset(new CompactStepPlanCodec(CompactStepPlanCodec::Resolution(nh.param("compact_position_resolution", 1e-4),
+                                                                                               nh.param("compact_orientation_resolution", 1e-6),
+                                                                                               nh.param("compact_parameter_resolution", 1e-4))));
+    compact_feedback_encoder_ = CompactFeedbackEncoder(static_cast<unsigned int>(std::max(nh.param("compact_key_frame_interval", 10), 1)));
+  }
+
+  // init diagnostics (must be set up before any plugin is loaded)
+  double diagnostics_rate = nh.param("diagnostics_rate", 1.0);
+  if (diagnostics_rate > 0.0)
+    diagnostics_.reset(new StepControllerDiagnostics(nh, auto_spin ? nh.param("rate", 10.0) : 0.0, diagnostics_rate));
+
+  // init introspection (must be set up before any plugin is loaded)
+  double introspection_rate = nh.param("introspection_rate", 0.0);
+  if (introspection_rate > 0.0)
+    step_queue_introspection_.reset(new StepQueueIntrospection(nh, boost::bind(&StepController::getSnapshot, this), introspection_rate,
+                                                               nh.param("introspection_full_state_period", 10.0)));
+
+  // init checkpointing (must be set up before any plugin is loaded)
+  std::string checkpoint_file = nh.param("checkpoint_file", std::string());
+  if (!checkpoint_file.empty())
+  {
+    checkpoint_.reset(new ExecutionCheckpoint(checkpoint_file, static_cast<size_t>(std::max(nh.param("checkpoint_max_size", 1048576), 1024))));
+    if (!checkpoint_->isOpen())
+      checkpoint_.reset();
+  }
+
   vigir_pluginlib::PluginManager::addPluginClassLoader<vigir_footstep_planning::StepPlanMsgPlugin>("vigir_footstep_planning_plugins", "vigir_footstep_planning::StepPlanMsgPlugin");
   vigir_pluginlib::PluginManager::addPluginClassLoader<StepControllerPlugin>("vigir_step_control", "vigir_step_control::StepControllerPlugin");
+  vigir_pluginlib::PluginManager::addPluginClassLoader<StepPreprocessingStage>("vigir_step_control", "vigir_step_control::StepPreprocessingStage");
+
+  // init preprocessing stage chain (must be set up before any step controller plugin is loaded)
+  ros::WallTime plugins_start = ros::WallTime::now();
+  std::vector<std::string> preprocessing_stages;
+  nh.getParam("preprocessing_stages", preprocessing_stages);
+  if (!preprocessing_stages.empty())
+  {
+    std::vector<StepPreprocessingStage::ConstPtr> stages;
+    for (const std::string& stage_name : preprocessing_stages)
+    {
+      StepPreprocessingStage::Ptr stage;
+      if (loadPlugin(stage_name, stage))
+        stages.push_back(stage);
+    }
+
+    step_preprocessor_.reset(new StepPreprocessor(stages, static_cast<unsigned int>(std::max(nh.param("preprocessing_threads", 1), 1)),
+                                                  static_cast<unsigned int>(std::max(nh.param("preprocessing_lookahead", 20), 1))));
+  }
 
   // init step plan msg plugin
+  ros::WallTime msg_plugin_start = ros::WallTime::now();
   loadPlugin(nh.param("step_plan_msg_plugin", std::string("step_plan_msg_plugin")), step_plan_msg_plugin_);
 
   // init walk controller plugin
+  ros::WallTime controller_plugin_start = ros::WallTime::now();
   loadPlugin(nh.param("step_controller_plugin", std::string("step_controller_test_plugin")), step_controller_plugin_);
-  if (step_controller_plugin_)
-    step_controller_plugin_->setStepPlanMsgPlugin(step_plan_msg_plugin_);
+  configureStepControllerPlugin(step_controller_plugin_);
+  ros::WallTime plugins_end = ros::WallTime::now();
+
+  // continue execution interrupted by a respawn of the node
+  if (checkpoint_)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    StepControllerSnapshot checkpoint;
+    if (step_controller_plugin_ && checkpoint_->read(checkpoint, ros::WallDuration(nh.param("checkpoint_max_age", 5.0))) &&
+        step_controller_plugin_->restore(checkpoint))
+      ROS_INFO("[StepController] Restored execution from checkpoint '%s' in %.2f ms.", checkpoint_file.c_str(), (ros::WallTime::now() - start).toSec() * 1e3);
+
+    checkpoint_->start(boost::bind(&StepController::getSnapshot, this), nh.param("checkpoint_rate", 10.0));
+  }
+
+  // init callback groups; update cycles are serialized by the controller lock anyway, so a single control thread suffices
+  // plugin load requests must be processed in order of arrival, so they are handled by a single thread as well
+  ros::NodeHandle ingestion_nh, action_nh, plugin_nh, control_nh;
+  ingestion_spinner_ = createCallbackSpinner(nh, "ingestion", std::numeric_limits<int>::max(), ingestion_nh);
+  action_spinner_ = createCallbackSpinner(nh, "action", std::numeric_limits<int>::max(), action_nh);
+  plugin_spinner_ = createCallbackSpinner(nh, "plugin", 1, plugin_nh);
+  control_spinner_ = createCallbackSpinner(nh, "control", 1, control_nh);
 
   // subscribe topics
-  load_step_plan_msg_plugin_sub_ = nh.subscribe("load_step_plan_msg_plugin", 1, &StepController::loadStepPlanMsgPlugin, this);
-  load_step_controller_plugin_sub_ = nh.subscribe("load_step_controller_plugin", 1, &StepController::loadStepControllerPlugin, this);
-  execute_step_plan_sub_ = nh.subscribe("execute_step_plan", 1, &StepController::executeStepPlan, this);
+  load_step_plan_msg_plugin_sub_ = plugin_nh.subscribe("load_step_plan_msg_plugin", 1, &StepController::loadStepPlanMsgPlugin, this);
+  load_step_controller_plugin_sub_ = plugin_nh.subscribe("load_step_controller_plugin", 1, &StepController::loadStepControllerPlugin, this);
+  execute_step_plan_sub_ = ingestion_nh.subscribe("execute_step_plan", 1, &StepController::executeStepPlan, this);
+  execute_step_plan_chunk_sub_ = ingestion_nh.subscribe("execute_step_plan_chunk", 10, &StepController::executeStepPlanChunk, this);
+  execute_step_plan_file_sub_ = ingestion_nh.subscribe("execute_step_plan_file", 1, &StepController::executeStepPlanFile, this);
+  if (compact_transport_)
+    execute_step_plan_compact_sub_ = ingestion_nh.subscribe("execute_step_plan_compact", 1, &StepController::executeStepPlanCompact, this);
+  drift_correction_sub_ = ingestion_nh.subscribe("drift_correction", 1, &StepController::applyDriftCorrection, this);
+
+  ros::NodeHandle emergency_stop_nh(nh);
+  emergency_stop_nh.setCallbackQueue(&emergency_stop_queue_);
+  emergency_stop_sub_ = emergency_stop_nh.subscribe("emergency_stop", 1, &StepController::emergencyStop, this);
+  emergency_stop_spinner_.reset(new ros::AsyncSpinner(1, &emergency_stop_queue_));
+  emergency_stop_spinner_->start();
 
   // publish topics
   planning_feedback_pub_ = nh.advertise<msgs::ExecuteStepPlanFeedback>("execute_feedback", 1, true);
+  execution_timeline_pub_ = nh.advertise<ExecutionTimeline>("execution_timeline", 1, true);
+  backpressure_pub_ = nh.advertise<Backpressure>("backpressure", 1, true);
+  if (compact_transport_)
+    compact_feedback_pub_ = nh.advertise<CompactFeedback>("execute_feedback_compact", 1, true);
 
   // init action servers
-  execute_step_plan_as_.reset(new ExecuteStepPlanActionServer(nh, "execute_step_plan", false));
+  execute_step_plan_as_.reset(new ExecuteStepPlanActionServer(action_nh, "execute_step_plan", false));
   execute_step_plan_as_->registerGoalCallback(boost::bind(&StepController::executeStepPlanAction, this, boost::ref(execute_step_plan_as_)));
   execute_step_plan_as_->registerPreemptCallback(boost::bind(&StepController::executePreemptionAction, this, boost::ref(execute_step_plan_as_)));
 
@@ -37,40 +194,326 @@ StepController::StepController(ros::NodeHandle& nh, bool auto_spin)
 
   // schedule main update loop
   if (auto_spin)
-    update_timer_ = nh.createTimer(nh.param("rate", 10.0), &StepController::update, this);
+    update_timer_ = control_nh.createTimer(nh.param("rate", 10.0), &StepController::update, this);
+
+  // one-shot timer is created once and rearmed by scheduleSendDeadline() for each deadline
+  if (deadline_scheduling_)
+    deadline_timer_ = control_nh.createTimer(ros::Duration(1.0), &StepController::update, this, true, false);
+
+  // callbacks are not served before the controller has been set up completely
+  for (CallbackSpinner::Ptr spinner : { control_spinner_, action_spinner_, ingestion_spinner_, plugin_spinner_ })
+  {
+    if (spinner)
+      spinner->start();
+  }
+
+  startup_time_ = ros::WallTime::now() - startup_start;
+  if (diagnostics_)
+    diagnostics_->recordStartup(startup_time_);
+
+  ROS_INFO("[StepController] Ready to walk after %.1f ms (preprocessing stages: %.1f ms, step plan msg plugin: %.1f ms, step controller plugin: %.1f ms).",
+           startup_time_.toSec() * 1e3, (msg_plugin_start - plugins_start).toSec() * 1e3, (controller_plugin_start - msg_plugin_start).toSec() * 1e3,
+           (plugins_end - controller_plugin_start).toSec() * 1e3);
+
+  double max_startup_time = nh.param("max_startup_time", 0.0);
+  if (max_startup_time > 0.0 && startup_time_.toSec() > max_startup_time)
+    ROS_WARN("[StepController] Startup took longer than %.1f ms!", max_startup_time * 1e3);
+
+  // plugins which may be switched to later are loaded in background after being ready to walk
+  std::vector<std::string> preload_plugins;
+  nh.getParam("preload_step_controller_plugins", preload_plugins);
+  if (!preload_plugins.empty())
+  {
+    plugin_preload_thread_ = boost::thread(&StepController::preloadStepControllerPlugins, this, preload_plugins);
+
+    // preloading must never compete with the control loop; requested loads don't wait for it (see plugin_loader_thread_)
+    setThreadPriority(plugin_preload_thread_, -1);
+  }
 }
 
 StepController::~StepController()
 {
+  // stop all threads before anything else gets destroyed
+  emergency_stop_spinner_->stop();
+  for (CallbackSpinner::Ptr spinner : { control_spinner_, action_spinner_, ingestion_spinner_, plugin_spinner_ })
+  {
+    if (spinner)
+      spinner->stop();
+  }
+  {
+    boost::unique_lock<boost::mutex> lock(pending_plugin_mutex_);
+    plugin_loader_shutdown_ = true;
+  }
+  plugin_load_condition_.notify_all();
+  plugin_loader_thread_.join();
+  plugin_preload_thread_.join();
+  step_preprocessor_.reset();
+
+  // clean shutdown; nothing to be continued by the next start
+  if (checkpoint_)
+  {
+    checkpoint_->stop();
+    checkpoint_->clear();
+    checkpoint_.reset();
+  }
+
+  diagnostics_.reset();
+  step_queue_introspection_.reset();
 }
 
 void StepController::executeStepPlan(const msgs::StepPlan& step_plan)
 {
+  executeStepPlan(msgs::StepPlanConstPtr(new msgs::StepPlan(step_plan)));
+}
+
+void StepController::executeStepPlan(const msgs::StepPlanConstPtr& step_plan)
+{
+  // newest step plan supersedes any step plan still waiting to be merged
+  {
+    boost::unique_lock<boost::mutex> lock(pending_step_plan_mutex_);
+    if (pending_step_plan_)
+      coalesced_plans_++;
+    pending_step_plan_ = step_plan;
+  }
+
   boost::unique_lock<boost::shared_mutex> lock(controller_mutex_);
 
   if (!step_controller_plugin_)
   {
     ROS_ERROR("[StepController] executeStepPlan: No step_controller_plugin available!");
+    discardPendingStepPlan();
     return;
   }
 
-  // An empty step plan will always trigger a soft stop
-  if (step_plan.steps.empty())
-    step_controller_plugin_->stop();
+  // step plans requested after an emergency stop start a new execution
+  completeEmergencyStop();
+
+  // pending step plan may have been merged by another thread in the meantime
+  mergePendingStepPlan();
+}
+
+void StepController::executeStepPlanChunk(const StepPlanChunk& chunk)
+{
+  boost::unique_lock<boost::shared_mutex> lock(controller_mutex_);
+
+  if (!step_controller_plugin_)
+  {
+    ROS_ERROR("[StepController] executeStepPlanChunk: No step_controller_plugin available!");
+    return;
+  }
+
+  completeEmergencyStop();
+
+  // first chunk starts a new stream
+  if (chunk.seq == 0u)
+  {
+    discardPendingStepPlan();
+    closeStepPlanFile();
+    streaming_ = true;
+    stream_plan_id_ = chunk.plan_id;
+    stream_next_seq_ = 0u;
+    dropPendingChunks();
+
+    // take over chunks which have overtaken the first one
+    std::map<unsigned int, EarlyChunks>::iterator early_itr = early_chunks_.find(chunk.plan_id);
+    if (early_itr != early_chunks_.end())
+    {
+      pending_chunks_.swap(early_itr->second.chunks);
+      early_chunks_.erase(early_itr);
+    }
+  }
+  else if (chunk.plan_id != stream_plan_id_ || stream_next_seq_ == 0u)
+  {
+    // first chunk of this plan may still be on its way
+    EarlyChunks& early = early_chunks_[chunk.plan_id];
+    early.last_received = ros::WallTime::now();
+    early.chunks[chunk.seq] = chunk;
+
+    // keep memory bounded even without stream timeout
+    if (early_chunks_.size() > MAX_EARLY_STREAMS)
+    {
+      std::map<unsigned int, EarlyChunks>::iterator oldest = early_chunks_.begin();
+      for (std::map<unsigned int, EarlyChunks>::iterator itr = early_chunks_.begin(); itr != early_chunks_.end(); itr++)
+      {
+        if (itr->second.last_received < oldest->second.last_received)
+          oldest = itr;
+      }
+      STEP_CONTROL_WARN("[StepController] executeStepPlanChunk: Dropped chunks of plan %u as its first chunk has not been received.", oldest->first);
+      if (diagnostics_)
+        diagnostics_->recordDroppedChunks(oldest->second.chunks.size());
+      early_chunks_.erase(oldest);
+    }
+    return;
+  }
+  else if (!streaming_)
+  {
+    STEP_CONTROL_WARN("[StepController] executeStepPlanChunk: Dropped chunk %u of inactive plan %u.", chunk.seq, chunk.plan_id);
+    if (diagnostics_)
+      diagnostics_->recordDroppedChunks(1u);
+    return;
+  }
+  else if (chunk.seq < stream_next_seq_)
+  {
+    STEP_CONTROL_WARN("[StepController] executeStepPlanChunk: Dropped duplicate chunk %u of plan %u.", chunk.seq, chunk.plan_id);
+    if (diagnostics_)
+      diagnostics_->recordDroppedChunks(1u);
+    return;
+  }
+
+  pending_chunks_[chunk.seq] = chunk;
+  stream_last_chunk_time_ = ros::WallTime::now();
+
+  mergePendingChunks();
+}
+
+bool StepController::executeStepPlanFile(const std::string& file_name)
+{
+  // mapping the file is done without holding the lock, so the control loop is not blocked
+  StepPlanFile::Ptr plan_file(new StepPlanFile(file_name));
+  if (!plan_file->isOpen())
+    return false;
+
+  if (plan_file->size() == 0u)
+  {
+    ROS_ERROR("[StepController] executeStepPlanFile: Step plan file '%s' contains no steps!", file_name.c_str());
+    return false;
+  }
+
+  boost::unique_lock<boost::shared_mutex> lock(controller_mutex_);
+
+  if (!step_controller_plugin_)
+  {
+    ROS_ERROR("[StepController] executeStepPlanFile: No step_controller_plugin available!");
+    return false;
+  }
+
+  completeEmergencyStop();
+
+  // a step plan file terminates any streamed step plan
+  if (streaming_)
+  {
+    streaming_ = false;
+    dropPendingChunks();
+  }
+
+  discardPendingStepPlan();
+  closeStepPlanFile();
+
+  // first window is merged like a regular step plan
+  plan_file->getStepPlan(plan_file_buffer_, plan_file->firstStepIndex(), plan_file->firstStepIndex() + plan_file_lookahead_ - 1);
+
+  ros::WallTime merge_start = ros::WallTime::now();
+  step_controller_plugin_->updateStepPlan(plan_file_buffer_);
+  if (diagnostics_)
+    diagnostics_->recordMerge(ros::WallTime::now() - merge_start);
+
+  if (step_controller_plugin_->getStepQueue()->lastStepIndex() != plan_file_buffer_.steps.back().step_index)
+  {
+    ROS_ERROR("[StepController] executeStepPlanFile: Could not merge step plan file '%s'!", file_name.c_str());
+    return false;
+  }
+
+  plan_file_ = plan_file;
+  plan_file_next_step_index_ = plan_file_buffer_.steps.back().step_index + 1;
+
+  ROS_INFO("[StepController] executeStepPlanFile: Executing %lu steps of step plan file '%s'.", plan_file_->size(), file_name.c_str());
+
+  if (plan_file_next_step_index_ > plan_file_->lastStepIndex())
+    closeStepPlanFile();
   else
-    step_controller_plugin_->updateStepPlan(step_plan);
+  {
+    step_controller_plugin_->setStepPlanComplete(false);
+    plan_file_->release(plan_file_next_step_index_);
+    plan_file_->prefetch(plan_file_next_step_index_, plan_file_next_step_index_ + plan_file_lookahead_ - 1);
+  }
+
+  return true;
+}
+
+void StepController::applyDriftCorrection(const tf::Transform& correction)
+{
+  boost::unique_lock<boost::shared_mutex> lock(controller_mutex_);
+
+  if (!step_controller_plugin_)
+  {
+    ROS_ERROR("[StepController] applyDriftCorrection: No step_controller_plugin available!");
+    return;
+  }
+
+  step_controller_plugin_->applyDriftCorrection(correction);
+}
+
+void StepController::emergencyStop()
+{
+  ros::WallTime start = ros::WallTime::now();
+
+  // the plugin may be replaced concurrently by the update cycle
+  StepControllerPlugin::Ptr plugin = boost::atomic_load(&step_controller_plugin_);
+  if (plugin)
+    plugin->emergencyStop();
+
+  // the stop must have reached the plugin before the update cycle may complete it
+  emergency_stop_pending_ = true;
+
+  ros::WallDuration latency = ros::WallTime::now() - start;
+
+  // step plans requested before the stop must not be merged anymore; this may wait for ingestion,
+  // so it is done after the stop has been forwarded to the walking engine
+  discardPendingStepPlan();
+
+  if (diagnostics_)
+    diagnostics_->recordEmergencyStop(latency);
+
+  STEP_CONTROL_WARN("[StepController] emergencyStop: Stop forwarded to walking engine within %.1f us.", latency.toSec() * 1e6);
 }
 
 void StepController::update(const ros::TimerEvent& event)
 {
   boost::unique_lock<boost::shared_mutex> lock(controller_mutex_);
 
+  // replace plugin at cycle boundary when a new one has been loaded
+  if (plugin_swap_pending_)
+    swapStepControllerPlugin();
+
   if (!step_controller_plugin_)
   {
-    ROS_ERROR_THROTTLE(5.0, "[StepController] update: No step_controller_plugin available!");
+    STEP_CONTROL_ERROR_THROTTLE(5.0, "[StepController] update: No step_controller_plugin available!");
     return;
   }
 
+  completeEmergencyStop();
+
+  // step plan and chunks deferred by the merge rate budget
+  mergePendingStepPlan();
+  mergePendingChunks();
+
+  pageInStepPlanFile();
+
+  checkStreamTimeout();
+
+  // keep step indices bounded; streams, files and pending step plans refer to the current indices
+  if (continuous_mode_ && rebase_step_index_ > 0 && !streaming_ && !plan_file_ &&
+      step_controller_plugin_->getFeedbackState().last_performed_step_index >= rebase_step_index_)
+  {
+    bool step_plan_pending;
+    {
+      boost::unique_lock<boost::mutex> pending_lock(pending_step_plan_mutex_);
+      step_plan_pending = static_cast<bool>(pending_step_plan_);
+    }
+
+    // rebasing touches the whole queue, so ingestion must not wait for it
+    if (!step_plan_pending)
+      step_index_offset_ += step_controller_plugin_->rebaseStepIndices();
+  }
+
+  ros::WallTime cycle_start = ros::WallTime::now();
+
+  // data needed to detect steady state cycles
+  size_t allocation_count = AllocationCounter::count();
+  unsigned int feedback_version = step_controller_plugin_->getFeedbackVersion();
+  int last_step_index_sent = step_controller_plugin_->getLastStepIndexSent();
+  int next_step_index_needed = step_controller_plugin_->getNextStepIndexNeeded();
+
   // Save current state to be able to handle action server correctly;
   // We must not send setSucceeded/setAborted state while sending the
   // final feedback message in the same update cycle!
@@ -82,8 +525,19 @@ void StepController::update(const ros::TimerEvent& event)
   // process
   step_controller_plugin_->process(event);
 
+  // preprocess steps which have not been sent yet
+  if (step_preprocessor_)
+    step_preprocessor_->schedule(std::max(step_controller_plugin_->getFeedbackState().first_changeable_step_index,
+                                          step_controller_plugin_->getLastStepIndexSent()+1));
+
   // publish feedback
   publishFeedback();
+  publishBackpressure();
+  publishExecutionTimeline();
+
+  // wake up in time for next step
+  if (deadline_scheduling_)
+    scheduleSendDeadline();
 
   // update action server
   switch (state)
@@ -104,10 +558,369 @@ void StepController::update(const ros::TimerEvent& event)
 
   // post process
   step_controller_plugin_->postProcess(event);
+
+  // provide current execution state for introspection and checkpointing
+  if (step_queue_introspection_ || checkpoint_)
+    step_controller_plugin_->updateSnapshot();
+
+  if (check_invariants_)
+  {
+    unsigned int violations = step_controller_plugin_->checkInvariants();
+    invariant_violations_ += violations;
+    if (diagnostics_)
+      diagnostics_->recordInvariantViolations(violations);
+  }
+
+  if (diagnostics_)
+  {
+    diagnostics_->recordState(step_controller_plugin_->getState());
+    diagnostics_->recordStepsSent(step_controller_plugin_->getLastStepIndexSent() - last_step_index_sent);
+    diagnostics_->recordCycle(cycle_start, ros::WallTime::now());
+  }
+
+  // in steady state (nothing has changed) no heap allocations must occur
+  if (check_allocations_ && feedback_version == step_controller_plugin_->getFeedbackVersion() &&
+      last_step_index_sent == step_controller_plugin_->getLastStepIndexSent() &&
+      next_step_index_needed == step_controller_plugin_->getNextStepIndexNeeded())
+  {
+    size_t allocations = AllocationCounter::count() - allocation_count;
+    if (allocations > 0)
+    {
+      steady_state_allocations_ += allocations;
+      STEP_CONTROL_ERROR_THROTTLE(1.0, "[StepController] update: %lu heap allocation(s) in steady state cycle!", allocations);
+    }
+  }
 }
 
-void StepController::publishFeedback() const
+void StepController::completeEmergencyStop()
 {
+  if (!emergency_stop_pending_.exchange(false))
+    return;
+
+  // stops requested while cleaning up remain active until the next cycle completes them
+  unsigned int requests = step_controller_plugin_->getEmergencyStopRequests();
+
+  // walking engine has been already stopped; just clean up
+  streaming_ = false;
+  dropPendingChunks();
+  plan_file_.reset();
+  step_controller_plugin_->stop();
+  step_controller_plugin_->completeEmergencyStop(requests);
+
+  if (execute_step_plan_as_->isActive())
+    execute_step_plan_as_->setAborted(msgs::ExecuteStepPlanResult());
+}
+
+void StepController::mergePendingStepPlan()
+{
+  ros::WallTime now = ros::WallTime::now();
+
+  msgs::StepPlanConstPtr step_plan;
+  {
+    boost::unique_lock<boost::mutex> lock(pending_step_plan_mutex_);
+    if (!pending_step_plan_)
+      return;
+
+    // soft stops are never throttled
+    if (!pending_step_plan_->steps.empty() && !min_merge_interval_.isZero() && now - last_merge_time_ < min_merge_interval_)
+      return;
+
+    step_plan.swap(pending_step_plan_);
+  }
+
+  // rejected step plans must not affect the running execution
+  int queue_size;
+  if (exceedsMaxQueueSize(*step_plan, queue_size))
+  {
+    STEP_CONTROL_ERROR("[StepController] mergePendingStepPlan: Rejected step plan as resulting queue size (%i) exceeds maximum queue size (%i)!", queue_size, max_queue_size_);
+    rejected_plans_++;
+    if (diagnostics_)
+      diagnostics_->recordRejectedPlan();
+    return;
+  }
+
+  // a complete step plan terminates any streamed step plan
+  if (streaming_)
+  {
+    streaming_ = false;
+    dropPendingChunks();
+    step_controller_plugin_->setStepPlanComplete(true);
+  }
+
+  closeStepPlanFile();
+
+  // An empty step plan will always trigger a soft stop
+  if (step_plan->steps.empty())
+  {
+    step_controller_plugin_->stop();
+    return;
+  }
+
+  step_controller_plugin_->updateStepPlan(*step_plan);
+
+  last_merge_time_ = now;
+  last_merge_duration_ = ros::WallTime::now() - now;
+  merged_plans_++;
+
+  if (diagnostics_)
+    diagnostics_->recordMerge(last_merge_duration_);
+}
+
+void StepController::mergePendingChunks()
+{
+  // merge all consecutive chunks received so far
+  std::map<unsigned int, StepPlanChunk>::iterator itr;
+  while (streaming_ && (itr = pending_chunks_.find(stream_next_seq_)) != pending_chunks_.end())
+  {
+    const StepPlanChunk& next_chunk = itr->second;
+
+    ros::WallTime merge_start = ros::WallTime::now();
+
+    // each chunk consumes the merge rate budget; remaining chunks are merged by the following update cycles
+    if (!min_merge_interval_.isZero() && merge_start - last_merge_time_ < min_merge_interval_)
+      return;
+
+    bool success;
+    int queue_size;
+    if (exceedsMaxQueueSize(next_chunk.step_plan, queue_size))
+    {
+      STEP_CONTROL_ERROR("[StepController] mergePendingChunks: Rejected chunk %u of plan %u as resulting queue size (%i) exceeds maximum queue size (%i)!",
+                         next_chunk.seq, next_chunk.plan_id, queue_size, max_queue_size_);
+      rejected_plans_++;
+      if (diagnostics_)
+        diagnostics_->recordRejectedPlan();
+      success = false;
+    }
+    else if (next_chunk.seq == 0u)
+    {
+      step_controller_plugin_->updateStepPlan(next_chunk.step_plan);
+      success = next_chunk.step_plan.steps.empty() ||
+                step_controller_plugin_->getStepQueue()->lastStepIndex() == next_chunk.step_plan.steps.back().step_index;
+    }
+    else
+      success = step_controller_plugin_->extendStepPlan(next_chunk.step_plan);
+
+    if (success)
+    {
+      last_merge_time_ = merge_start;
+      last_merge_duration_ = ros::WallTime::now() - merge_start;
+
+      if (diagnostics_)
+        diagnostics_->recordMerge(last_merge_duration_);
+    }
+
+    // abort stream; the plugin will handle missing steps as soon as they are needed
+    if (!success)
+    {
+      STEP_CONTROL_ERROR("[StepController] mergePendingChunks: Could not merge chunk %u of plan %u. Stream aborted!", next_chunk.seq, next_chunk.plan_id);
+      streaming_ = false;
+    }
+    else if (next_chunk.last_chunk)
+    {
+      STEP_CONTROL_INFO("[StepController] mergePendingChunks: Received last chunk %u of plan %u.", next_chunk.seq, next_chunk.plan_id);
+      streaming_ = false;
+    }
+
+    step_controller_plugin_->setStepPlanComplete(!streaming_);
+
+    pending_chunks_.erase(itr);
+    stream_next_seq_++;
+  }
+
+  // chunks beyond the last or a failed chunk are never merged
+  if (!streaming_)
+    dropPendingChunks();
+}
+
+void StepController::dropPendingChunks()
+{
+  if (diagnostics_)
+    diagnostics_->recordDroppedChunks(pending_chunks_.size());
+
+  pending_chunks_.clear();
+}
+
+bool StepController::exceedsMaxQueueSize(const msgs::StepPlan& step_plan, int& queue_size) const
+{
+  queue_size = 0;
+
+  if (max_queue_size_ <= 0 || step_plan.steps.empty())
+    return false;
+
+  // queue has to hold all steps from its first step up to the end of the merged plan
+  StepQueue::ConstPtr step_queue = step_controller_plugin_->getStepQueue();
+  queue_size = step_queue->empty() ? step_plan.steps.back().step_index + 1 : step_plan.steps.back().step_index - step_queue->firstStepIndex() + 1;
+  return queue_size > max_queue_size_;
+}
+
+void StepController::discardPendingStepPlan()
+{
+  boost::unique_lock<boost::mutex> lock(pending_step_plan_mutex_);
+  if (pending_step_plan_)
+  {
+    coalesced_plans_++;
+    pending_step_plan_.reset();
+  }
+}
+
+void StepController::pageInStepPlanFile()
+{
+  if (!plan_file_)
+    return;
+
+  // execution has been stopped or the queue has been changed otherwise meanwhile
+  StepControllerState state = step_controller_plugin_->getState();
+  if ((state != READY && state != ACTIVE && state != PAUSED) || step_controller_plugin_->getStepQueue()->lastStepIndex() != plan_file_next_step_index_-1)
+  {
+    plan_file_.reset();
+    return;
+  }
+
+  // steps are appended in windows of plan_file_lookahead steps as soon as the walking engine approaches the queue end
+  int horizon = std::max(step_controller_plugin_->getLastStepIndexSent(), step_controller_plugin_->getNextStepIndexNeeded()) + plan_file_lookahead_;
+  if (plan_file_next_step_index_ > horizon)
+    return;
+
+  plan_file_->getStepPlan(plan_file_buffer_, plan_file_next_step_index_, plan_file_next_step_index_ + plan_file_lookahead_ - 1);
+
+  if (!step_controller_plugin_->extendStepPlan(plan_file_buffer_))
+  {
+    STEP_CONTROL_ERROR("[StepController] pageInStepPlanFile: Could not enqueue step %i of step plan file. Paging aborted!", plan_file_next_step_index_);
+    closeStepPlanFile();
+    return;
+  }
+
+  plan_file_next_step_index_ += static_cast<int>(plan_file_buffer_.steps.size());
+
+  // enqueued steps are held by the step queue
+  plan_file_->release(plan_file_next_step_index_);
+
+  if (plan_file_next_step_index_ > plan_file_->lastStepIndex())
+    closeStepPlanFile();
+  else
+    plan_file_->prefetch(plan_file_next_step_index_, plan_file_next_step_index_ + plan_file_lookahead_ - 1);
+}
+
+void StepController::checkStreamTimeout()
+{
+  if (stream_timeout_.isZero())
+    return;
+
+  ros::WallTime now = ros::WallTime::now();
+
+  if (streaming_ && now - stream_last_chunk_time_ > stream_timeout_)
+  {
+    STEP_CONTROL_ERROR("[StepController] checkStreamTimeout: No chunk of plan %u received for %.1f s. Stream completed with %u chunk(s).",
+                       stream_plan_id_, stream_timeout_.toSec(), stream_next_seq_);
+    streaming_ = false;
+    dropPendingChunks();
+
+    if (diagnostics_)
+      diagnostics_->recordStreamTimeout();
+
+    // the plugin will stop at the end of the queue
+    step_controller_plugin_->setStepPlanComplete(true);
+  }
+
+  // first chunk of these plans has been lost
+  std::map<unsigned int, EarlyChunks>::iterator itr = early_chunks_.begin();
+  while (itr != early_chunks_.end())
+  {
+    if (now - itr->second.last_received > stream_timeout_)
+    {
+      STEP_CONTROL_WARN("[StepController] checkStreamTimeout: Dropped chunks of plan %u as its first chunk has not been received.", itr->first);
+      if (diagnostics_)
+        diagnostics_->recordDroppedChunks(itr->second.chunks.size());
+      early_chunks_.erase(itr++);
+    }
+    else
+      itr++;
+  }
+}
+
+void StepController::closeStepPlanFile()
+{
+  if (!plan_file_)
+    return;
+
+  plan_file_.reset();
+  step_controller_plugin_->setStepPlanComplete(true);
+}
+
+StepControllerSnapshot::ConstPtr StepController::getSnapshot() const
+{
+  StepControllerPlugin::Ptr plugin = boost::atomic_load(&step_controller_plugin_);
+  return plugin ? plugin->getSnapshot() : StepControllerSnapshot::ConstPtr();
+}
+
+size_t StepController::getInvariantViolations() const
+{
+  return invariant_violations_.load();
+}
+
+size_t StepController::getSteadyStateAllocations() const
+{
+  return steady_state_allocations_.load();
+}
+
+void StepController::configureStepControllerPlugin(StepControllerPlugin::Ptr plugin)
+{
+  if (!plugin)
+    return;
+
+  plugin->setStepPlanMsgPlugin(step_plan_msg_plugin_);
+  plugin->setStepQueueCapacity(static_cast<size_t>(std::max(queue_capacity_, 0)), queue_fixed_capacity_);
+  plugin->setAsyncExecution(async_execution_, async_execution_timeout_, static_cast<unsigned int>(std::max(max_steps_in_flight_, 1)));
+  plugin->setSnapshotEnabled(step_queue_introspection_ || checkpoint_);
+  plugin->setDeadlineScheduling(deadline_scheduling_, deadline_safety_margin_);
+  plugin->setReplanTolerance(replan_tolerance_);
+  plugin->setContinuousMode(continuous_mode_);
+  plugin->setStepPreprocessor(step_preprocessor_);
+
+  if (step_preprocessor_)
+    step_preprocessor_->setStepQueue(plugin->getStepQueue());
+
+  if (diagnostics_)
+    diagnostics_->setStepQueue(plugin->getStepQueue());
+}
+
+CallbackSpinner::Ptr StepController::createCallbackSpinner(ros::NodeHandle& nh, const std::string& group, int max_threads, ros::NodeHandle& group_nh) const
+{
+  group_nh = nh;
+
+  int threads = std::min(nh.param("callback_groups/" + group + "/threads", 0), max_threads);
+  if (threads <= 0)
+    return CallbackSpinner::Ptr();
+
+  CallbackSpinner::Ptr spinner(new CallbackSpinner(group, static_cast<unsigned int>(threads), nh.param("callback_groups/" + group + "/priority", 0)));
+  group_nh.setCallbackQueue(spinner->getCallbackQueue());
+  return spinner;
+}
+
+void StepController::scheduleSendDeadline()
+{
+  ros::Time deadline = step_controller_plugin_->getNextSendDeadline();
+  if (deadline.isZero() || deadline == scheduled_deadline_)
+    return;
+
+  scheduled_deadline_ = deadline;
+
+  // timer period must be positive
+  ros::Duration time_left = std::max(deadline - ros::Time::now(), ros::Duration(0.001));
+  deadline_timer_.stop();
+  deadline_timer_.setPeriod(time_left);
+  deadline_timer_.start();
+}
+
+void StepController::publishFeedback()
+{
+  // publish only when feedback has changed if requested
+  unsigned int feedback_version = step_controller_plugin_->getFeedbackVersion();
+  if (feedback_on_change_only_ && feedback_version == last_published_feedback_version_)
+    return;
+
+  last_published_feedback_version_ = feedback_version;
+
   if (step_controller_plugin_->getState() != READY)
   {
     const msgs::ExecuteStepPlanFeedback& feedback = step_controller_plugin_->getFeedbackState();
@@ -115,16 +928,202 @@ void StepController::publishFeedback() const
     // publish feedback
     planning_feedback_pub_.publish(feedback);
 
+    if (compact_transport_)
+    {
+      compact_feedback_encoder_.encode(feedback, compact_feedback_.data);
+      compact_feedback_pub_.publish(compact_feedback_);
+    }
+
     if (execute_step_plan_as_->isActive())
       execute_step_plan_as_->publishFeedback(feedback);
   }
 }
 
+void StepController::publishBackpressure()
+{
+  StepQueue::ConstPtr step_queue = step_controller_plugin_->getStepQueue();
+
+  uint32_t queue_size = static_cast<uint32_t>(step_queue->size());
+  int32_t credit = max_queue_size_ > 0 ? std::max(max_queue_size_ - static_cast<int>(queue_size), 0) : -1;
+
+  bool merge_pending;
+  uint32_t coalesced_plans;
+  {
+    boost::unique_lock<boost::mutex> lock(pending_step_plan_mutex_);
+    merge_pending = static_cast<bool>(pending_step_plan_);
+    coalesced_plans = coalesced_plans_;
+  }
+
+  StepReplanStats replan_stats = step_controller_plugin_->getReplanStats();
+  uint32_t total_invalidated_steps = static_cast<uint32_t>(replan_stats.total_invalidated_steps);
+
+  // publish only when signal has changed
+  if (backpressure_.queue_size == queue_size && backpressure_.credit == credit && backpressure_.merge_pending == merge_pending &&
+      backpressure_.merged_plans == merged_plans_ && backpressure_.coalesced_plans == coalesced_plans &&
+      backpressure_.rejected_plans == rejected_plans_ && backpressure_.last_invalidated_steps == replan_stats.last_invalidated_steps &&
+      backpressure_.total_invalidated_steps == total_invalidated_steps && backpressure_.step_index_offset == step_index_offset_ &&
+      !backpressure_.header.stamp.isZero())
+    return;
+
+  backpressure_.header.stamp = ros::Time::now();
+  backpressure_.queue_size = queue_size;
+  backpressure_.max_queue_size = static_cast<uint32_t>(std::max(max_queue_size_, 0));
+  backpressure_.credit = credit;
+  backpressure_.min_merge_interval = ros::Duration(min_merge_interval_.toSec());
+  backpressure_.last_merge_duration = ros::Duration(last_merge_duration_.toSec());
+  backpressure_.merge_pending = merge_pending;
+  backpressure_.merged_plans = merged_plans_;
+  backpressure_.coalesced_plans = coalesced_plans;
+  backpressure_.rejected_plans = rejected_plans_;
+  backpressure_.last_invalidated_steps = replan_stats.last_invalidated_steps;
+  backpressure_.total_invalidated_steps = total_invalidated_steps;
+  backpressure_.step_index_offset = step_index_offset_;
+
+  backpressure_pub_.publish(backpressure_);
+}
+
+void StepController::publishExecutionTimeline()
+{
+  if (execution_timeline_pub_.getNumSubscribers() == 0u)
+    return;
+
+  // predictions change only with queue content or execution progress
+  unsigned int feedback_version = step_controller_plugin_->getFeedbackVersion();
+  unsigned int queue_version = step_controller_plugin_->getStepQueue()->version();
+  if (feedback_version == last_published_timeline_feedback_version_ && queue_version == last_published_timeline_queue_version_)
+    return;
+
+  last_published_timeline_feedback_version_ = feedback_version;
+  last_published_timeline_queue_version_ = queue_version;
+
+  step_controller_plugin_->getExecutionTimeline(execution_timeline_);
+  execution_timeline_pub_.publish(execution_timeline_);
+}
+
+void StepController::loadStepControllerPluginAsync(const std::string& plugin_name)
+{
+  StepControllerPlugin::Ptr plugin;
+
+  // each preloaded instance is used once only
+  {
+    boost::unique_lock<boost::mutex> lock(pending_plugin_mutex_);
+    std::map<std::string, StepControllerPlugin::Ptr>::iterator itr = preloaded_plugins_.find(plugin_name);
+    if (itr != preloaded_plugins_.end())
+    {
+      plugin = itr->second;
+      preloaded_plugins_.erase(itr);
+    }
+  }
+
+  if (plugin)
+    ROS_INFO("[StepController] Using preloaded plugin '%s'.", plugin_name.c_str());
+  else if (!loadPlugin(plugin_name, plugin))
+    return;
+
+  boost::unique_lock<boost::mutex> lock(pending_plugin_mutex_);
+  pending_step_controller_plugin_ = plugin;
+  plugin_swap_pending_ = true;
+}
+
+void StepController::processPluginLoadRequests()
+{
+  while (true)
+  {
+    std::string plugin_name;
+
+    {
+      boost::unique_lock<boost::mutex> lock(pending_plugin_mutex_);
+      while (plugin_load_requests_.empty() && !plugin_loader_shutdown_)
+        plugin_load_condition_.wait(lock);
+
+      if (plugin_loader_shutdown_)
+        return;
+
+      // only the latest request matters as each loaded plugin replaces the pending one anyway
+      plugin_name = plugin_load_requests_.back();
+      plugin_load_requests_.clear();
+    }
+
+    loadStepControllerPluginAsync(plugin_name);
+  }
+}
+
+void StepController::preloadStepControllerPlugins(const std::vector<std::string>& plugin_names)
+{
+  for (const std::string& plugin_name : plugin_names)
+  {
+    ros::WallTime start = ros::WallTime::now();
+
+    StepControllerPlugin::Ptr plugin;
+    if (!loadPlugin(plugin_name, plugin))
+      continue;
+
+    {
+      boost::unique_lock<boost::mutex> lock(pending_plugin_mutex_);
+      preloaded_plugins_[plugin_name] = plugin;
+    }
+
+    ROS_INFO("[StepController] Preloaded plugin '%s' in %.1f ms.", plugin_name.c_str(), (ros::WallTime::now() - start).toSec() * 1e3);
+  }
+}
+
+void StepController::swapStepControllerPlugin()
+{
+  StepControllerPlugin::Ptr plugin;
+
+  {
+    boost::unique_lock<boost::mutex> lock(pending_plugin_mutex_);
+    plugin.swap(pending_step_controller_plugin_);
+    plugin_swap_pending_ = false;
+  }
+
+  if (!plugin || plugin == step_controller_plugin_)
+    return;
+
+  // configuration applies to the queue of the new plugin, so it must not alter the queue taken over afterwards
+  // (e.g. mark a streamed step plan as complete or reserve the arena again)
+  configureStepControllerPlugin(plugin);
+
+  // transfer execution state to new plugin
+  StepControllerPlugin::Ptr previous = step_controller_plugin_;
+  unsigned int emergency_stop_requests = 0u;
+  if (previous)
+  {
+    plugin->takeOver(*previous);
+    emergency_stop_requests = plugin->getEmergencyStopRequests();
+
+    if (step_preprocessor_)
+      step_preprocessor_->setStepQueue(plugin->getStepQueue());
+
+    if (diagnostics_)
+      diagnostics_->setStepQueue(plugin->getStepQueue());
+  }
+
+  boost::atomic_store(&step_controller_plugin_, plugin);
+
+  // emergency stop may have reached the previous plugin only after its state has been taken over
+  if (previous && previous->getEmergencyStopRequests() != emergency_stop_requests)
+    step_controller_plugin_->emergencyStop();
+
+  // pending log events may refer to the library of the previous plugin, so it is released by the logger thread
+  if (previous)
+    LogRing::instance().releaseAfterFlush(previous);
+
+  STEP_CONTROL_INFO("[StepController] Replaced step controller plugin in state '%s'.", toCString(step_controller_plugin_->getState()));
+}
+
 // --- Subscriber calls ---
 
 void StepController::loadStepPlanMsgPlugin(const std_msgs::StringConstPtr& plugin_name)
 {
-  loadPlugin(plugin_name->data, step_plan_msg_plugin_);
+  // loading is done without holding the lock, so the control loop is not blocked
+  vigir_footstep_planning::StepPlanMsgPlugin::Ptr plugin;
+  if (!loadPlugin(plugin_name->data, plugin))
+    return;
+
+  boost::unique_lock<boost::shared_mutex> lock(controller_mutex_);
+
+  step_plan_msg_plugin_ = plugin;
 
   if (step_controller_plugin_)
     step_controller_plugin_->setStepPlanMsgPlugin(step_plan_msg_plugin_);
@@ -132,15 +1131,50 @@ void StepController::loadStepPlanMsgPlugin(const std_msgs::StringConstPtr& plugi
 
 void StepController::loadStepControllerPlugin(const std_msgs::StringConstPtr& plugin_name)
 {
-  loadPlugin(plugin_name->data, step_controller_plugin_);
+  // plugin is loaded and initialized in background and swapped in by the next update cycle
+  {
+    boost::unique_lock<boost::mutex> lock(pending_plugin_mutex_);
+    plugin_load_requests_.push_back(plugin_name->data);
 
-  if (step_controller_plugin_)
-    step_controller_plugin_->setStepPlanMsgPlugin(step_plan_msg_plugin_);
+    // loader thread is started on first request and serves all following ones, so this callback never waits for a load
+    if (!plugin_loader_thread_.joinable())
+      plugin_loader_thread_ = boost::thread(&StepController::processPluginLoadRequests, this);
+  }
+  plugin_load_condition_.notify_one();
 }
 
-void StepController::executeStepPlan(const msgs::StepPlanConstPtr& step_plan)
+void StepController::executeStepPlanChunk(const StepPlanChunkConstPtr& chunk)
+{
+  executeStepPlanChunk(*chunk);
+}
+
+void StepController::applyDriftCorrection(const geometry_msgs::TransformConstPtr& correction)
+{
+  tf::Transform transform;
+  tf::transformMsgToTF(*correction, transform);
+  applyDriftCorrection(transform);
+}
+
+void StepController::executeStepPlanFile(const std_msgs::StringConstPtr& file_name)
+{
+  executeStepPlanFile(file_name->data);
+}
+
+void StepController::executeStepPlanCompact(const CompactStepPlanConstPtr& compact_step_plan)
+{
+  msgs::StepPlan::Ptr step_plan(new msgs::StepPlan());
+  if (!compact_step_plan_codec_->decode(compact_step_plan->data, *step_plan))
+  {
+    ROS_ERROR("[StepController] executeStepPlanCompact: Dropped corrupted step plan.");
+    return;
+  }
+
+  executeStepPlan(msgs::StepPlanConstPtr(step_plan));
+}
+
+void StepController::emergencyStop(const std_msgs::EmptyConstPtr& /*empty*/)
 {
-  executeStepPlan(*step_plan);
+  emergencyStop();
 }
 
 //--- action server calls ---
@@ -156,7 +1190,8 @@ void StepController::executeStepPlanAction(ExecuteStepPlanActionServerPtr& as)
     return;
   }
 
-  executeStepPlan(goal->step_plan);
+  // step plan shares ownership with the goal, so it is not copied
+  executeStepPlan(msgs::StepPlanConstPtr(goal, &goal->step_plan));
 }
 
 void StepController::executePreemptionAction(ExecuteStepPlanActionServerPtr& as)
@@ -164,6 +1199,8 @@ void StepController::executePreemptionAction(ExecuteStepPlanActionServerPtr& as)
   if (as->isActive())
     as->setPreempted();
 
-  //step_controller_plugin->stop();
+  // preemption must not wait for running merges; a new goal replacing the current one is merged as usual
+  if (!as->isNewGoalAvailable())
+    emergencyStop();
 }
 } // namespace
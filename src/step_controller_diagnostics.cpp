@@ -0,0 +1,299 @@
+#include <vigir_step_control/step_controller_diagnostics.h>
+
+#include <cmath>
+#include <sstream>
+
+#include <vigir_step_control/thread_utils.h>
+
+
+
+namespace vigir_step_control
+{
+template<typename T>
+static void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const T& value)
+{
+  std::ostringstream ss;
+  ss << value;
+
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = ss.str();
+  status.values.push_back(kv);
+}
+
+template<typename T>
+static void updateMax(boost::atomic<T>& max, T value)
+{
+  T current = max.load(boost::memory_order_relaxed);
+  while (value > current && !max.compare_exchange_weak(current, value, boost::memory_order_relaxed));
+}
+
+StepControllerDiagnostics::StepControllerDiagnostics(ros::NodeHandle& nh, double expected_rate, double rate)
+  : expected_period_(expected_rate > 0.0 ? 1.0/expected_rate : 0.0)
+  , period_(1.0/rate)
+  , cycle_count_(0u)
+  , overrun_count_(0u)
+  , max_cycle_duration_(0)
+  , max_cycle_interval_(0)
+  , state_(NOT_READY)
+  , steps_sent_(0u)
+  , invariant_violations_(0u)
+  , rejected_plans_(0u)
+  , dropped_chunks_(0u)
+  , stream_timeouts_(0u)
+  , emergency_stop_count_(0u)
+  , last_emergency_stop_latency_(0)
+  , max_emergency_stop_latency_(0)
+  , startup_time_(0)
+  , last_cycle_count_(0u)
+  , last_overrun_count_(0u)
+  , last_steps_sent_(0u)
+  , last_invariant_violations_(0u)
+{
+  for (size_t i = 0; i < MERGE_LATENCY_BUCKETS; i++)
+    merge_latency_histogram_[i] = 0u;
+
+  diagnostics_pub_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+
+  last_evaluation_ = ros::WallTime::now();
+
+  thread_ = boost::thread(&StepControllerDiagnostics::run, this);
+
+  // diagnostics must never compete with the control loop
+  setThreadPriority(thread_, -1);
+}
+
+StepControllerDiagnostics::~StepControllerDiagnostics()
+{
+  thread_.interrupt();
+  thread_.join();
+}
+
+void StepControllerDiagnostics::setStepQueue(StepQueue::ConstPtr step_queue)
+{
+  boost::atomic_store(&step_queue_, step_queue);
+}
+
+void StepControllerDiagnostics::recordCycle(const ros::WallTime& start, const ros::WallTime& end)
+{
+  int64_t duration = (end - start).toNSec();
+
+  if (!last_cycle_start_.isZero())
+    updateMax(max_cycle_interval_, (start - last_cycle_start_).toNSec());
+  last_cycle_start_ = start;
+
+  updateMax(max_cycle_duration_, duration);
+
+  // cycle did not finish before next one was due
+  if (!expected_period_.isZero() && duration > expected_period_.toNSec())
+    overrun_count_++;
+
+  cycle_count_++;
+}
+
+void StepControllerDiagnostics::recordMerge(const ros::WallDuration& latency)
+{
+  int64_t ticks = latency.toNSec() / MERGE_LATENCY_RESOLUTION;
+
+  size_t bucket = 0u;
+  while (ticks > 0 && bucket < MERGE_LATENCY_BUCKETS-1)
+  {
+    ticks >>= 1;
+    bucket++;
+  }
+
+  merge_latency_histogram_[bucket]++;
+}
+
+void StepControllerDiagnostics::recordRejectedPlan()
+{
+  rejected_plans_++;
+}
+
+void StepControllerDiagnostics::recordDroppedChunks(size_t chunks)
+{
+  if (chunks > 0u)
+    dropped_chunks_ += chunks;
+}
+
+void StepControllerDiagnostics::recordStreamTimeout()
+{
+  stream_timeouts_++;
+}
+
+void StepControllerDiagnostics::recordStepsSent(int steps)
+{
+  if (steps > 0)
+    steps_sent_ += static_cast<size_t>(steps);
+}
+
+void StepControllerDiagnostics::recordState(StepControllerState state)
+{
+  state_.store(state, boost::memory_order_relaxed);
+}
+
+void StepControllerDiagnostics::recordInvariantViolations(unsigned int violations)
+{
+  if (violations > 0u)
+    invariant_violations_ += violations;
+}
+
+void StepControllerDiagnostics::recordEmergencyStop(const ros::WallDuration& latency)
+{
+  last_emergency_stop_latency_.store(latency.toNSec(), boost::memory_order_relaxed);
+  updateMax(max_emergency_stop_latency_, latency.toNSec());
+  emergency_stop_count_++;
+}
+
+void StepControllerDiagnostics::recordStartup(const ros::WallDuration& duration)
+{
+  startup_time_.store(duration.toNSec(), boost::memory_order_relaxed);
+}
+
+void StepControllerDiagnostics::run()
+{
+  try
+  {
+    while (ros::ok())
+    {
+      boost::this_thread::sleep(boost::posix_time::microseconds(period_.toNSec() / 1000));
+
+      diagnostic_msgs::DiagnosticArray msg;
+      msg.header.stamp = ros::Time::now();
+      msg.status.resize(1);
+      generateStatus(msg.status.front());
+
+      diagnostics_pub_.publish(msg);
+    }
+  }
+  catch (boost::thread_interrupted&)
+  {
+  }
+}
+
+void StepControllerDiagnostics::generateStatus(diagnostic_msgs::DiagnosticStatus& status)
+{
+  ros::WallTime now = ros::WallTime::now();
+  double dt = (now - last_evaluation_).toSec();
+  last_evaluation_ = now;
+
+  StepControllerState state = static_cast<StepControllerState>(state_.load(boost::memory_order_relaxed));
+
+  // control loop
+  size_t cycle_count = cycle_count_.load();
+  size_t overrun_count = overrun_count_.load();
+  double update_rate = dt > 0.0 ? static_cast<double>(cycle_count - last_cycle_count_) / dt : 0.0;
+  size_t overruns = overrun_count - last_overrun_count_;
+  double max_cycle_duration = static_cast<double>(max_cycle_duration_.exchange(0)) * 1e-6;
+  double max_cycle_interval = static_cast<double>(max_cycle_interval_.exchange(0)) * 1e-6;
+  last_cycle_count_ = cycle_count;
+  last_overrun_count_ = overrun_count;
+
+  // execution
+  size_t steps_sent = steps_sent_.load();
+  double steps_per_second = dt > 0.0 ? static_cast<double>(steps_sent - last_steps_sent_) / dt : 0.0;
+  last_steps_sent_ = steps_sent;
+
+  size_t invariant_violations = invariant_violations_.load();
+  size_t new_invariant_violations = invariant_violations - last_invariant_violations_;
+  last_invariant_violations_ = invariant_violations;
+
+  size_t histogram[MERGE_LATENCY_BUCKETS];
+  size_t merge_count = 0u;
+  for (size_t i = 0; i < MERGE_LATENCY_BUCKETS; i++)
+  {
+    histogram[i] = merge_latency_histogram_[i].load();
+    merge_count += histogram[i];
+  }
+
+  status.name = ros::this_node::getName() + ": Step Controller";
+  status.hardware_id = ros::this_node::getName();
+
+  // determine health
+  double expected_rate = expected_period_.isZero() ? 0.0 : 1.0/expected_period_.toSec();
+  if (state == FAILED)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+    status.message = "Execution failed";
+  }
+  else if (new_invariant_violations > 0)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+    status.message = "Invariant violations";
+  }
+  else if (overruns > 0)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "Update cycle overruns";
+  }
+  else if (expected_rate > 0.0 && update_rate < 0.8 * expected_rate)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "Update rate too low";
+  }
+  else
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = "OK";
+  }
+
+  addValue(status, "State", toString(state));
+  addValue(status, "Update rate [Hz]", update_rate);
+  addValue(status, "Expected update rate [Hz]", expected_rate);
+  addValue(status, "Max cycle duration [ms]", max_cycle_duration);
+  addValue(status, "Max cycle interval [ms]", max_cycle_interval);
+  addValue(status, "Cycle overruns", overruns);
+  addValue(status, "Cycle overruns (total)", overrun_count);
+  addValue(status, "Steps per second", steps_per_second);
+  addValue(status, "Steps sent (total)", steps_sent);
+  addValue(status, "Invariant violations (total)", invariant_violations);
+  addValue(status, "Emergency stops (total)", emergency_stop_count_.load());
+  addValue(status, "Emergency stop latency (last) [us]", static_cast<double>(last_emergency_stop_latency_.load()) * 1e-3);
+  addValue(status, "Emergency stop latency (max) [us]", static_cast<double>(max_emergency_stop_latency_.load()) * 1e-3);
+  addValue(status, "Startup time [ms]", static_cast<double>(startup_time_.load()) * 1e-6);
+  addValue(status, "Merged step plans (total)", merge_count);
+  addValue(status, "Merge latency p50 [ms]", getMergeLatencyPercentile(histogram, merge_count, 0.5) * 1e3);
+  addValue(status, "Merge latency p90 [ms]", getMergeLatencyPercentile(histogram, merge_count, 0.9) * 1e3);
+  addValue(status, "Merge latency p99 [ms]", getMergeLatencyPercentile(histogram, merge_count, 0.99) * 1e3);
+  addValue(status, "Rejected plans (MAX_QUEUE_SIZE)", rejected_plans_.load());
+  addValue(status, "Dropped stream chunks (total)", dropped_chunks_.load());
+  addValue(status, "Stream timeouts (total)", stream_timeouts_.load());
+
+  StepQueue::ConstPtr step_queue = boost::atomic_load(&step_queue_);
+  if (step_queue)
+  {
+    StepQueue::ArenaStats stats = step_queue->getArenaStats();
+    addValue(status, "Queue depth", stats.size);
+    addValue(status, "Queue capacity", stats.capacity);
+    addValue(status, "Queue high water mark", stats.high_water_mark);
+
+    StepQueue::CacheStats cache_stats = step_queue->getCacheStats();
+    addValue(status, "Plan validation cache hits", cache_stats.validation_hits);
+    addValue(status, "Plan validation cache misses", cache_stats.validation_misses);
+    addValue(status, "No-op merges", cache_stats.noop_merges);
+
+    for (size_t i = 0; i < StepQueue::NUM_REJECT_REASONS; i++)
+    {
+      StepQueue::RejectReason reason = static_cast<StepQueue::RejectReason>(i);
+      addValue(status, "Rejected plans (" + toString(reason) + ")", step_queue->getRejectCount(reason));
+    }
+  }
+}
+
+double StepControllerDiagnostics::getMergeLatencyPercentile(const size_t* histogram, size_t count, double percentile) const
+{
+  if (count == 0u)
+    return 0.0;
+
+  size_t threshold = static_cast<size_t>(std::ceil(percentile * static_cast<double>(count)));
+  size_t sum = 0u;
+  for (size_t i = 0; i < MERGE_LATENCY_BUCKETS; i++)
+  {
+    sum += histogram[i];
+    if (sum >= threshold)
+      return static_cast<double>(MERGE_LATENCY_RESOLUTION << i) * 1e-9;
+  }
+
+  return static_cast<double>(MERGE_LATENCY_RESOLUTION << (MERGE_LATENCY_BUCKETS-1)) * 1e-9;
+}
+} // namespace
@@ -1,10 +1,17 @@
 #include <vigir_step_control/step_controller_plugin.h>
 
+#include <cmath>
+
 
 
 namespace vigir_step_control
 {
 std::string toString(const StepControllerState& state)
+{
+  return toCString(state);
+}
+
+const char* toCString(const StepControllerState& state)
 {
   switch (state)
   {
@@ -20,7 +27,23 @@ std::string toString(const StepControllerState& state)
 
 StepControllerPlugin::StepControllerPlugin()
   : vigir_pluginlib::Plugin("step_controller")
+  , async_execution_(false)
+  , async_execution_timeout_(1.0)
+  , max_steps_in_flight_(1u)
+  , deadline_scheduling_(false)
+  , deadline_safety_margin_(0.1)
+  , timing_step_index_(-1)
+  , acceptance_latency_mean_(0.0)
+  , acceptance_latency_deviation_(0.0)
+  , continuous_mode_(false)
+  , last_removed_step_index_(-1)
   , state_(NOT_READY)
+  , next_step_index_needed_(-1)
+  , last_step_index_sent_(-1)
+  , emergency_stop_requests_(0u)
+  , emergency_stops_completed_(0u)
+  , feedback_version_(0u)
+  , snapshot_enabled_(false)
 {
   step_queue_.reset(new StepQueue());
 
@@ -33,41 +56,195 @@ StepControllerPlugin::~StepControllerPlugin()
 
 void StepControllerPlugin::setStepPlanMsgPlugin(vigir_footstep_planning::StepPlanMsgPlugin::Ptr plugin)
 {
-  boost::unique_lock<boost::shared_mutex> lock(plugin_mutex_);
-
   if (plugin)
     step_plan_msg_plugin_ = plugin;
   else
     ROS_ERROR("[StepControllerPlugin] Null pointer to StepPlanMsgPlugin rejected! Fix it immediately!");
 }
 
+void StepControllerPlugin::setStepQueueCapacity(size_t capacity, bool fixed)
+{
+  step_queue_->reserve(capacity, fixed);
+}
+
+void StepControllerPlugin::setReplanTolerance(const StepQueue::Tolerance& tolerance)
+{
+  step_queue_->setMergeTolerance(tolerance);
+}
+
+StepReplanStats StepControllerPlugin::getReplanStats() const
+{
+  return replan_stats_;
+}
+
+void StepControllerPlugin::setStepPreprocessor(StepPreprocessor::ConstPtr preprocessor)
+{
+  step_preprocessor_ = preprocessor;
+}
+
+PreprocessedStep::ConstPtr StepControllerPlugin::getPreprocessedStep(const msgs::Step& step) const
+{
+  if (!step_preprocessor_)
+    return PreprocessedStep::ConstPtr();
+
+  PreprocessedStep::ConstPtr result = step_queue_->getPreprocessedStep(step.step_index);
+  if (result)
+    return result;
+
+  STEP_CONTROL_DEBUG("[StepControllerPlugin] Step %i has not been preprocessed in time.", step.step_index);
+  return step_preprocessor_->process(step);
+}
+
+StepQueue::ConstPtr StepControllerPlugin::getStepQueue() const
+{
+  return step_queue_;
+}
+
+void StepControllerPlugin::setAsyncExecution(bool enable, double timeout, unsigned int max_steps_in_flight)
+{
+  async_execution_ = enable;
+  async_execution_timeout_ = ros::WallDuration(timeout);
+  max_steps_in_flight_ = std::max(max_steps_in_flight, 1u);
+}
+
+bool StepControllerPlugin::isAsyncExecutionEnabled() const
+{
+  return async_execution_;
+}
+
+void StepControllerPlugin::setDeadlineScheduling(bool enable, double safety_margin)
+{
+  deadline_scheduling_ = enable;
+  deadline_safety_margin_ = ros::Duration(safety_margin);
+}
+
+void StepControllerPlugin::setContinuousMode(bool enable)
+{
+  continuous_mode_ = enable;
+  step_queue_->setPlanComplete(!continuous_mode_);
+}
+
+bool StepControllerPlugin::isContinuousModeEnabled() const
+{
+  return continuous_mode_;
+}
+
+int StepControllerPlugin::rebaseStepIndices()
+{
+  // steps not performed yet must keep non-negative indices
+  int offset = feedback_state_.last_performed_step_index + 1;
+  if (!step_queue_->empty())
+    offset = std::min(offset, step_queue_->firstStepIndex());
+
+  if (offset <= 0 || !step_queue_->rebase(offset))
+    return 0;
+
+  // negative indices are placeholders and are kept
+  auto rebased = [offset](int step_index) { return step_index < 0 ? step_index : std::max(step_index - offset, -1); };
+
+  msgs::ExecuteStepPlanFeedback feedback = feedback_state_;
+  feedback.last_performed_step_index = rebased(feedback.last_performed_step_index);
+  feedback.currently_executing_step_index = rebased(feedback.currently_executing_step_index);
+  feedback.first_changeable_step_index = rebased(feedback.first_changeable_step_index);
+  setFeedbackState(feedback);
+
+  setNextStepIndexNeeded(rebased(getNextStepIndexNeeded()));
+  setLastStepIndexSent(rebased(getLastStepIndexSent()));
+
+  for (StepInFlight& request : steps_in_flight_)
+    request.step_index = rebased(request.step_index);
+
+  timing_step_index_ = rebased(timing_step_index_);
+  last_removed_step_index_ = rebased(last_removed_step_index_);
+
+  updateQueueFeedback();
+
+  onRebase(offset);
+
+  STEP_CONTROL_INFO("[StepControllerPlugin] Rebased step indices by %i. Current queue has steps in range [%i; %i].", offset, step_queue_->firstStepIndex(), step_queue_->lastStepIndex());
+
+  return offset;
+}
+
+ros::Time StepControllerPlugin::getNextSendDeadline() const
+{
+  if (getState() != ACTIVE)
+    return ros::Time();
+
+  int last_step_index_requested = steps_in_flight_.empty() ? getLastStepIndexSent() : steps_in_flight_.back().step_index;
+  return getSendDeadline(last_step_index_requested+1);
+}
+
+ros::Time StepControllerPlugin::getEstimatedFinishTime(int step_index) const
+{
+  if (getState() != ACTIVE || timing_step_index_ < 0 || step_index < timing_step_index_ || step_index > step_queue_->lastStepIndex())
+    return ros::Time();
+
+  return timing_step_start_ + ros::Duration(step_queue_->getStepDuration(timing_step_index_, step_index)) + getExecutionDelay();
+}
+
+int StepControllerPlugin::getStepIndexAt(const ros::Time& time) const
+{
+  if (getState() != ACTIVE || timing_step_index_ < 0)
+    return -1;
+
+  // past times are mapped to the currently executing step
+  if (time <= timing_step_start_)
+    return timing_step_index_;
+
+  return step_queue_->getStepIndexAt(timing_step_index_, (time - timing_step_start_ - getExecutionDelay()).toSec());
+}
+
+void StepControllerPlugin::getExecutionTimeline(ExecutionTimeline& timeline) const
+{
+  timeline.header.stamp = ros::Time::now();
+  timeline.first_step_index = -1;
+  timeline.finish_times.clear();
+
+  if (getState() != ACTIVE || timing_step_index_ < 0 || !step_queue_->getStepFinishTimes(timing_step_index_, finish_times_buffer_))
+    return;
+
+  ros::Time start = timing_step_start_ + getExecutionDelay();
+
+  timeline.first_step_index = timing_step_index_;
+  timeline.finish_times.resize(finish_times_buffer_.size());
+  for (size_t i = 0; i < finish_times_buffer_.size(); i++)
+    timeline.finish_times[i] = start + ros::Duration(finish_times_buffer_[i]);
+}
+
 StepControllerState StepControllerPlugin::getState() const
 {
-  boost::shared_lock<boost::shared_mutex> lock(plugin_mutex_);
-  return state_;
+  return state_.load();
 }
 
 int StepControllerPlugin::getNextStepIndexNeeded() const
 {
-  boost::shared_lock<boost::shared_mutex> lock(plugin_mutex_);
-  return next_step_index_needed_;
+  return next_step_index_needed_.load();
 }
 
 int StepControllerPlugin::getLastStepIndexSent() const
 {
-  boost::shared_lock<boost::shared_mutex> lock(plugin_mutex_);
-  return last_step_index_sent_;
+  return last_step_index_sent_.load();
 }
 
 const msgs::ExecuteStepPlanFeedback& StepControllerPlugin::getFeedbackState() const
 {
-  boost::shared_lock<boost::shared_mutex> lock(plugin_mutex_);
   return feedback_state_;
 }
 
+unsigned int StepControllerPlugin::getFeedbackVersion() const
+{
+  return feedback_version_.load();
+}
+
 void StepControllerPlugin::reset()
 {
   step_queue_->reset();
+  if (continuous_mode_)
+    step_queue_->setPlanComplete(false);
+  steps_in_flight_.clear();
+  timing_step_index_ = -1;
+  last_removed_step_index_ = -1;
 
   msgs::ExecuteStepPlanFeedback feedback;
   feedback.last_performed_step_index = -1;
@@ -83,36 +260,111 @@ void StepControllerPlugin::reset()
 
 void StepControllerPlugin::setState(StepControllerState state)
 {
-  boost::unique_lock<boost::shared_mutex> lock(plugin_mutex_);
-  ROS_INFO("[StepControllerPlugin] Switching state from '%s' to '%s'.", toString(this->state_).c_str(), toString(state).c_str());
-  this->state_ = state;
+  StepControllerState previous_state = state_.exchange(state);
+  STEP_CONTROL_INFO("[StepControllerPlugin] Switching state from '%s' to '%s'.", toCString(previous_state), toCString(state));
   feedback_state_.controller_state = state;
+  feedback_version_++;
 }
 
 void StepControllerPlugin::setNextStepIndexNeeded(int index)
 {
-  boost::unique_lock<boost::shared_mutex> lock(plugin_mutex_);
-  next_step_index_needed_ = index;
+  next_step_index_needed_.store(index);
 }
 
 void StepControllerPlugin::setLastStepIndexSent(int index)
 {
-  boost::unique_lock<boost::shared_mutex> lock(plugin_mutex_);
-  last_step_index_sent_ = index;
+  last_step_index_sent_.store(index);
+}
+
+void StepControllerPlugin::resendStepsFrom(int step_index)
+{
+  if (getLastStepIndexSent() >= step_index)
+    setLastStepIndexSent(step_index-1);
+  discardStepsInFlight(step_index);
 }
 
 void StepControllerPlugin::setFeedbackState(const msgs::ExecuteStepPlanFeedback& feedback)
 {
-  boost::unique_lock<boost::shared_mutex> lock(plugin_mutex_);
   this->feedback_state_ = feedback;
+  this->feedback_state_.controller_state = state_.load();
+  feedback_version_++;
 }
 
 void StepControllerPlugin::updateQueueFeedback()
 {
-  boost::unique_lock<boost::shared_mutex> lock(plugin_mutex_);
-  feedback_state_.queue_size = static_cast<int>(step_queue_->size());
-  feedback_state_.first_queued_step_index = step_queue_->firstStepIndex();
-  feedback_state_.last_queued_step_index = step_queue_->lastStepIndex();
+  // queue is always continuous, so its size is determined by the step indices
+  int first_queued_step_index = step_queue_->firstStepIndex();
+  int last_queued_step_index = step_queue_->lastStepIndex();
+  int queue_size = first_queued_step_index >= 0 ? last_queued_step_index - first_queued_step_index + 1 : 0;
+
+  if (feedback_state_.queue_size == queue_size && feedback_state_.first_queued_step_index == first_queued_step_index &&
+      feedback_state_.last_queued_step_index == last_queued_step_index)
+    return;
+
+  feedback_state_.queue_size = queue_size;
+  feedback_state_.first_queued_step_index = first_queued_step_index;
+  feedback_state_.last_queued_step_index = last_queued_step_index;
+  feedback_version_++;
+}
+
+void StepControllerPlugin::setSnapshotEnabled(bool enable)
+{
+  snapshot_enabled_ = enable;
+  step_queue_->setSnapshotEnabled(enable);
+
+  if (!snapshot_enabled_)
+    boost::atomic_store(&snapshot_, StepControllerSnapshot::ConstPtr());
+}
+
+void StepControllerPlugin::updateSnapshot()
+{
+  if (!snapshot_enabled_)
+    return;
+
+  StepControllerSnapshot::ConstPtr last = boost::atomic_load(&snapshot_);
+
+  StepControllerState state = state_.load();
+  int next_step_index_needed = next_step_index_needed_.load();
+  int last_step_index_sent = last_step_index_sent_.load();
+
+  // check if anything has changed
+  if (last && last->state == state &&
+      last->next_step_index_needed == next_step_index_needed && last->last_step_index_sent == last_step_index_sent &&
+      last->feedback.last_performed_step_index == feedback_state_.last_performed_step_index &&
+      last->feedback.currently_executing_step_index == feedback_state_.currently_executing_step_index &&
+      last->feedback.first_changeable_step_index == feedback_state_.first_changeable_step_index)
+    return;
+
+  boost::shared_ptr<StepControllerSnapshot> snapshot(new StepControllerSnapshot());
+  snapshot->state = state;
+  snapshot->next_step_index_needed = next_step_index_needed;
+  snapshot->last_step_index_sent = last_step_index_sent;
+  snapshot->feedback = feedback_state_;
+  snapshot->replan_invalidated_steps = replan_stats_.last_invalidated_steps;
+
+  boost::atomic_store(&snapshot_, StepControllerSnapshot::ConstPtr(snapshot));
+}
+
+StepControllerSnapshot::ConstPtr StepControllerPlugin::getSnapshot() const
+{
+  StepControllerSnapshot::ConstPtr state = boost::atomic_load(&snapshot_);
+  if (!state)
+    return state;
+
+  // queue content is copied by the calling thread, so the control thread never pays for it
+  StepQueue::Snapshot::ConstPtr queue = boost::atomic_load(&step_queue_)->getSnapshot();
+
+  boost::unique_lock<boost::mutex> lock(snapshot_mutex_);
+
+  if (!composed_snapshot_ || composed_state_ != state || composed_snapshot_->queue != queue)
+  {
+    boost::shared_ptr<StepControllerSnapshot> snapshot(new StepControllerSnapshot(*state));
+    snapshot->queue = queue;
+    composed_state_ = state;
+    composed_snapshot_ = snapshot;
+  }
+
+  return composed_snapshot_;
 }
 
 void StepControllerPlugin::updateStepPlan(const msgs::StepPlan& step_plan)
@@ -129,30 +381,99 @@ void StepControllerPlugin::updateStepPlan(const msgs::StepPlan& step_plan)
   state = getState();
   if (state == READY || state == ACTIVE)
   {
-    msgs::ExecuteStepPlanFeedback feedback = getFeedbackState();
+    int first_changeable_step_index = getFeedbackState().first_changeable_step_index;
+    int first_modified_step_index = first_changeable_step_index;
+    unsigned int queue_version = step_queue_->version();
 
-    if (step_queue_->updateStepPlan(step_plan, feedback.first_changeable_step_index))
+    // resubmitted step plans which don't change the queue are no replans
+    if (step_queue_->updateStepPlan(step_plan, first_changeable_step_index, &first_modified_step_index) &&
+        step_queue_->version() != queue_version)
     {
-      // resets last_step_index_sent counter to trigger (re)executing steps in process()
+      // resets last_step_index_sent counter to trigger (re)executing only modified steps in process()
       if (state == ACTIVE)
-        setLastStepIndexSent(feedback.first_changeable_step_index-1);
+      {
+        int last_step_index_sent = getLastStepIndexSent();
+        int invalidated_steps = std::max(last_step_index_sent - first_modified_step_index + 1, 0);
+
+        // in-flight requests below the first modified step stay in flight and are marked as sent on completion
+        resendStepsFrom(first_modified_step_index);
+
+        replan_stats_.replan_count++;
+        replan_stats_.last_invalidated_steps = invalidated_steps;
+        replan_stats_.total_invalidated_steps += static_cast<size_t>(invalidated_steps);
+        replan_stats_.total_preserved_steps += static_cast<size_t>(std::max(std::min(last_step_index_sent, first_modified_step_index-1) - first_changeable_step_index + 1, 0));
+
+        STEP_CONTROL_DEBUG("[StepControllerPlugin] Step plan update modified steps from index %i on; %i sent step(s) invalidated.", first_modified_step_index, invalidated_steps);
+      }
 
       updateQueueFeedback();
 
-      ROS_INFO("[StepControllerPlugin] Updated step queue. Current queue has steps in range [%i; %i].", step_queue_->firstStepIndex(), step_queue_->lastStepIndex());
+      STEP_CONTROL_INFO_THROTTLE(1.0, "[StepControllerPlugin] Updated step queue. Current queue has steps in range [%i; %i].", step_queue_->firstStepIndex(), step_queue_->lastStepIndex());
     }
   }
+  // restored execution must not be changed while the walking engine state is unknown
+  else if (state == PAUSED)
+    STEP_CONTROL_WARN("[StepControllerPlugin] updateStepPlan: Rejected step plan as restored execution is paused. Send an empty step plan to stop execution first.");
+}
+
+bool StepControllerPlugin::applyDriftCorrection(const tf::Transform& correction)
+{
+  // steps before the first changeable step are already committed by the walking engine
+  int first_changeable_step_index = getFeedbackState().first_changeable_step_index;
+  int from_step_index = std::max(first_changeable_step_index, step_queue_->firstStepIndex());
+  if (from_step_index < 0)
+    return false;
+
+  step_queue_->applyCorrection(correction, from_step_index);
+
+  if (getState() == ACTIVE)
+    resendStepsFrom(from_step_index);
+
+  STEP_CONTROL_INFO("[StepControllerPlugin] Applied drift correction to steps from index %i on.", from_step_index);
+
+  return true;
+}
+
+bool StepControllerPlugin::extendStepPlan(const msgs::StepPlan& step_plan)
+{
+  if (step_plan.steps.empty())
+    return true;
+
+  // Allow step plan extensions only in READY and ACTIVE state
+  StepControllerState state = getState();
+  if (state != READY && state != ACTIVE)
+    return false;
+
+  if (!step_queue_->extendStepPlan(step_plan))
+    return false;
+
+  updateQueueFeedback();
+
+  STEP_CONTROL_INFO_THROTTLE(1.0, "[StepControllerPlugin] Extended step queue. Current queue has steps in range [%i; %i].", step_queue_->firstStepIndex(), step_queue_->lastStepIndex());
+
+  return true;
+}
+
+void StepControllerPlugin::setStepPlanComplete(bool complete)
+{
+  // continuous walking never ends by running out of steps
+  step_queue_->setPlanComplete(complete && !continuous_mode_);
+}
+
+bool StepControllerPlugin::isStepPlanComplete() const
+{
+  return step_queue_->isPlanComplete();
 }
 
 void StepControllerPlugin::preProcess(const ros::TimerEvent& /*event*/)
 {
   // check if new walking request has been done
-  if (getState() == READY && !step_queue_->empty())
+  if (getState() == READY && !step_queue_->empty() && !isEmergencyStopped())
   {
     // check consisty
     if (step_queue_->firstStepIndex() != 0)
     {
-      ROS_ERROR("[StepControllerTestPlugin] Step plan doesn't start with initial step (step_index = 0). Execution aborted!");
+      STEP_CONTROL_ERROR("[StepControllerPlugin] Step plan doesn't start with initial step (step_index = 0). Execution aborted!");
       setState(FAILED);
     }
     else
@@ -167,57 +488,304 @@ void StepControllerPlugin::process(const ros::TimerEvent& /*event*/)
   // execute steps
   if (getState() == ACTIVE)
   {
-    // spool all requested steps
-    while (getLastStepIndexSent() < getNextStepIndexNeeded())
+    if (isAsyncExecutionEnabled())
+      spoolStepsAsync();
+    else
+      spoolSteps([this](const msgs::Step& step) { return executeStep(step); });
+  }
+}
+
+StepExecutionToken StepControllerPlugin::executeStepAsync(const msgs::Step& step)
+{
+  std::promise<bool> promise;
+  promise.set_value(executeStep(step));
+  return promise.get_future().share();
+}
+
+void StepControllerPlugin::updateExecutionTiming()
+{
+  int currently_executing_step_index = getFeedbackState().currently_executing_step_index;
+  if (currently_executing_step_index != timing_step_index_)
+  {
+    timing_step_index_ = currently_executing_step_index;
+    timing_step_start_ = ros::Time::now();
+  }
+}
+
+ros::Duration StepControllerPlugin::getExecutionDelay() const
+{
+  ros::Time expected_finish = timing_step_start_ + ros::Duration(step_queue_->getStepDuration(timing_step_index_, timing_step_index_));
+  ros::Time now = ros::Time::now();
+  return now > expected_finish ? now - expected_finish : ros::Duration(0.0);
+}
+
+void StepControllerPlugin::updateAcceptanceLatency(const ros::WallDuration& latency)
+{
+  // same estimator as used for TCP retransmission timeouts
+  double error = latency.toSec() - acceptance_latency_mean_;
+  acceptance_latency_mean_ += 0.125 * error;
+  acceptance_latency_deviation_ += 0.25 * (std::abs(error) - acceptance_latency_deviation_);
+}
+
+ros::Time StepControllerPlugin::getSendDeadline(int step_index) const
+{
+  // deadline can be only computed while walking engine is executing steps
+  if (!deadline_scheduling_ || timing_step_index_ < 0 || step_index > step_queue_->lastStepIndex())
+    return ros::Time();
+
+  // step is already overdue
+  if (step_index <= timing_step_index_)
+    return timing_step_start_;
+
+  ros::Duration time_to_start(step_queue_->getStepDuration(timing_step_index_, step_index-1));
+  ros::Duration acceptance_latency(acceptance_latency_mean_ + 4.0 * acceptance_latency_deviation_);
+
+  return timing_step_start_ + time_to_start - acceptance_latency - deadline_safety_margin_;
+}
+
+bool StepControllerPlugin::isSendDeadlineReached(int step_index) const
+{
+  if (!deadline_scheduling_)
+    return false;
+
+  ros::Time deadline = getSendDeadline(step_index);
+  return !deadline.isZero() && deadline <= ros::Time::now();
+}
+
+void StepControllerPlugin::spoolStepsAsync()
+{
+  updateExecutionTiming();
+
+  // advance last_step_index_sent in order of completed requests
+  while (!steps_in_flight_.empty())
+  {
+    StepInFlight& request = steps_in_flight_.front();
+
+    if (request.token.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
     {
-      // check if queue isn't empty
-      if (step_queue_->empty())
+      if (!request.token.get())
       {
-        ROS_ERROR("[StepControllerTestPlugin] Step %i required but not in queue. Execution aborted!", getNextStepIndexNeeded());
+        STEP_CONTROL_ERROR("[StepControllerPlugin] Error while execution request of step %i. Execution aborted!", request.step_index);
+        steps_in_flight_.clear();
         setState(FAILED);
         return;
       }
 
-      // determine next step index
-      int next_step_index = getLastStepIndexSent()+1;
-      msgs::Step step;
+      updateAcceptanceLatency(ros::WallTime::now() - request.request_time);
+      setLastStepIndexSent(request.step_index);
+      steps_in_flight_.pop_front();
+    }
+    else if (ros::WallTime::now() - request.request_time > async_execution_timeout_)
+    {
+      STEP_CONTROL_ERROR("[StepControllerPlugin] Execution request of step %i timed out. Execution aborted!", request.step_index);
+      steps_in_flight_.clear();
+      setState(FAILED);
+      return;
+    }
+    else
+      break;
+  }
 
-      // retrieve next step
-      if (!step_queue_->getStep(step, next_step_index))
-      {
-        ROS_ERROR("[StepControllerTestPlugin] Missing step %i in queue. Execution aborted!", next_step_index);
-        setState(FAILED);
-        return;
-      }
+  // request all needed steps
+  int next_step_index_needed = getNextStepIndexNeeded();
+  int last_step_index_requested = steps_in_flight_.empty() ? getLastStepIndexSent() : steps_in_flight_.back().step_index;
+
+  while (!isEmergencyStopped() && (last_step_index_requested < next_step_index_needed || isSendDeadlineReached(last_step_index_requested+1)) &&
+         steps_in_flight_.size() < max_steps_in_flight_)
+  {
+    int next_step_index = last_step_index_requested+1;
 
-      // sent step to walking engine
-      if (!executeStep(step))
+    // retrieve next step
+    if (!step_queue_->getStep(step_buffer_, next_step_index))
+    {
+      // step may not have been streamed yet
+      if (!step_queue_->isPlanComplete())
       {
-        ROS_ERROR("[StepControllerTestPlugin] Error while execution request of step %i. Execution aborted!", next_step_index);
-        setState(FAILED);
-        return;
+        STEP_CONTROL_WARN_THROTTLE(1.0, "[StepControllerPlugin] Step %i required but not streamed yet. Waiting...", next_step_index);
+        break;
       }
 
-      // increment last_step_index_sent
-      setLastStepIndexSent(next_step_index);
+      STEP_CONTROL_ERROR("[StepControllerPlugin] Missing step %i in queue. Execution aborted!", next_step_index);
+      steps_in_flight_.clear();
+      setState(FAILED);
+      return;
+    }
 
-      msgs::ExecuteStepPlanFeedback feedback = getFeedbackState();
+    // sent step to walking engine without waiting for completion
+    StepInFlight request;
+    request.step_index = next_step_index;
+    request.request_time = ros::WallTime::now();
+    request.token = executeStepAsync(step_buffer_);
 
-      // garbage collection: remove already executed steps
-      if (feedback.last_performed_step_index >= 0)
-        step_queue_->removeSteps(0, feedback.last_performed_step_index);
+    if (!request.token.valid())
+    {
+      STEP_CONTROL_ERROR("[StepControllerPlugin] Invalid execution request of step %i. Execution aborted!", next_step_index);
+      steps_in_flight_.clear();
+      setState(FAILED);
+      return;
+    }
 
-      // update feedback
-      updateQueueFeedback();
+    steps_in_flight_.push_back(request);
+    last_step_index_requested = next_step_index;
+  }
+
+  // garbage collection: remove already executed steps
+  removePerformedSteps();
+
+  // update feedback
+  updateQueueFeedback();
+}
+
+void StepControllerPlugin::removePerformedSteps()
+{
+  int last_performed_step_index = feedback_state_.last_performed_step_index;
+  if (last_performed_step_index < 0 || last_performed_step_index == last_removed_step_index_)
+    return;
+
+  step_queue_->removeSteps(0, last_performed_step_index);
+  last_removed_step_index_ = last_performed_step_index;
+}
+
+void StepControllerPlugin::discardStepsInFlight(int step_index)
+{
+  while (!steps_in_flight_.empty() && steps_in_flight_.back().step_index >= step_index)
+    steps_in_flight_.pop_back();
+}
+
+void StepControllerPlugin::takeOver(StepControllerPlugin& previous)
+{
+  if (&previous == this)
+    return;
+
+  // both plugins are owned by the calling thread, so no locking is required
+  step_queue_ = previous.step_queue_;
+  boost::atomic_store(&previous.step_queue_, StepQueue::Ptr(new StepQueue())); // may be read by getSnapshot()
+
+  state_.store(previous.state_.load());
+  next_step_index_needed_.store(previous.next_step_index_needed_.load());
+  last_step_index_sent_.store(previous.last_step_index_sent_.load());
+  emergency_stops_completed_.store(previous.emergency_stops_completed_.load());
+  emergency_stop_requests_.store(previous.emergency_stop_requests_.load());
+  feedback_state_ = previous.feedback_state_;
+  feedback_version_.store(previous.feedback_version_.load() + 1);
+  replan_stats_ = previous.replan_stats_;
+  last_removed_step_index_ = -1;
+  timing_step_index_ = previous.timing_step_index_;
+  timing_step_start_ = previous.timing_step_start_;
+
+  steps_in_flight_.swap(previous.steps_in_flight_);
+}
+
+bool StepControllerPlugin::restore(const StepControllerSnapshot& checkpoint)
+{
+  if (checkpoint.state != ACTIVE && checkpoint.state != PAUSED)
+    return false;
+
+  if (!checkpoint.queue || !step_queue_->restore(checkpoint.queue->steps, checkpoint.queue->plan_complete))
+    return false;
+
+  // execution is resumed only if the walking engine is known to be in sync
+  StepControllerState state = checkpoint.state == ACTIVE && confirmEngineState(checkpoint) ? ACTIVE : PAUSED;
+
+  state_.store(state);
+  next_step_index_needed_.store(checkpoint.next_step_index_needed);
+  last_step_index_sent_.store(checkpoint.last_step_index_sent);
+  feedback_state_ = checkpoint.feedback;
+  feedback_state_.controller_state = state;
+  feedback_version_++;
+
+  steps_in_flight_.clear();
+  timing_step_index_ = -1;
+  last_removed_step_index_ = -1;
+
+  if (state != checkpoint.state)
+    STEP_CONTROL_WARN("[StepControllerPlugin] Walking engine state not confirmed. Restored execution is paused until stopped.");
+
+  STEP_CONTROL_INFO("[StepControllerPlugin] Restored execution in state '%s' (last step sent: %i).", toCString(state), checkpoint.last_step_index_sent);
+
+  return true;
+}
+
+unsigned int StepControllerPlugin::checkInvariants() const
+{
+  unsigned int violations = 0u;
+
+  StepControllerState state = getState();
+  int next_step_index_needed = getNextStepIndexNeeded();
+  int last_step_index_sent = getLastStepIndexSent();
+  int first_queued_step_index = step_queue_->firstStepIndex();
+  int last_queued_step_index = step_queue_->lastStepIndex();
+
+  if (!step_queue_->checkIntegrity())
+  {
+    STEP_CONTROL_ERROR("[StepControllerPlugin] Invariant violated: Step queue [%i; %i] is inconsistent!", first_queued_step_index, last_queued_step_index);
+    violations++;
+  }
+
+  if (next_step_index_needed < -1 || last_step_index_sent < -1)
+  {
+    STEP_CONTROL_ERROR("[StepControllerPlugin] Invariant violated: Invalid step indices (needed: %i, sent: %i)!", next_step_index_needed, last_step_index_sent);
+    violations++;
+  }
+
+  if (state == ACTIVE && first_queued_step_index >= 0)
+  {
+    // no step beyond the end of the queue can be sent
+    if (last_step_index_sent > last_queued_step_index)
+    {
+      STEP_CONTROL_ERROR("[StepControllerPlugin] Invariant violated: Sent step %i beyond queue end %i!", last_step_index_sent, last_queued_step_index);
+      violations++;
+    }
+
+    // steps must not be removed before they have been performed
+    int last_performed_step_index = std::max(feedback_state_.last_performed_step_index, -1);
+    if (first_queued_step_index > last_performed_step_index+1)
+    {
+      STEP_CONTROL_ERROR("[StepControllerPlugin] Invariant violated: Queue starts at %i while only steps up to %i were performed!", first_queued_step_index, last_performed_step_index);
+      violations++;
     }
   }
+
+  // requests in flight must be ordered and follow the last sent step
+  int last_step_index_requested = last_step_index_sent;
+  for (const StepInFlight& request : steps_in_flight_)
+  {
+    if (request.step_index <= last_step_index_requested)
+    {
+      STEP_CONTROL_ERROR("[StepControllerPlugin] Invariant violated: Step %i in flight after step %i!", request.step_index, last_step_index_requested);
+      violations++;
+      break;
+    }
+    last_step_index_requested = request.step_index;
+  }
+
+  return violations;
 }
 
 void StepControllerPlugin::stop()
 {
-  boost::unique_lock<boost::shared_mutex> lock(plugin_mutex_);
-
-  ROS_INFO("[StepControllerTestPlugin] Stop requested. Resetting walk controller.");
+  STEP_CONTROL_INFO("[StepControllerPlugin] Stop requested. Resetting walk controller.");
   reset();
 }
+
+void StepControllerPlugin::emergencyStop()
+{
+  emergency_stop_requests_++;
+  onEmergencyStop();
+}
+
+unsigned int StepControllerPlugin::getEmergencyStopRequests() const
+{
+  return emergency_stop_requests_.load();
+}
+
+void StepControllerPlugin::completeEmergencyStop(unsigned int requests)
+{
+  emergency_stops_completed_.store(requests);
+}
+
+bool StepControllerPlugin::isEmergencyStopped() const
+{
+  return emergency_stops_completed_.load() != emergency_stop_requests_.load();
+}
 } // namespace
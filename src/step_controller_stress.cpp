@@ -0,0 +1,267 @@
+#include <vigir_step_control/step_controller_stress.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <vigir_generic_params/parameter_manager.h>
+#include <vigir_pluginlib/plugin_manager.h>
+
+
+
+namespace vigir_step_control
+{
+StepControllerStress::StepControllerStress(ros::NodeHandle& nh)
+  : running_(false)
+{
+  duration_ = ros::WallDuration(nh.param("duration", 10.0));
+  ingestion_threads_ = static_cast<unsigned int>(std::max(nh.param("ingestion_threads", 4), 1));
+  ingestion_rate_ = nh.param("ingestion_rate", 200.0);
+  update_rate_ = nh.param("update_rate", 1000.0);
+  plan_length_ = std::max(nh.param("plan_length", 20), 2);
+  invalid_plan_ratio_ = nh.param("invalid_plan_ratio", 0.2);
+  empty_plan_ratio_ = nh.param("empty_plan_ratio", 0.02);
+  reload_ratio_ = nh.param("reload_ratio", 0.005);
+  emergency_stop_ratio_ = nh.param("emergency_stop_ratio", 0.005);
+  reload_plugin_ = nh.param("step_controller_plugin", std::string("step_controller_test_plugin"));
+  seed_ = static_cast<unsigned int>(nh.param("seed", 0));
+
+  for (size_t i = 0; i < NUM_PLAN_TYPES; i++)
+    requests_[i] = 0u;
+
+  // latencies are recorded without allocating memory during the test
+  update_latencies_.reserve(static_cast<size_t>(std::ceil(duration_.toSec() * std::max(update_rate_, 1.0) * 1.5)) + 1u);
+
+  // each cycle has to verify the execution state
+  nh.setParam("check_invariants", true);
+  controller_.reset(new Controller(nh));
+}
+
+StepControllerStress::~StepControllerStress()
+{
+}
+
+bool StepControllerStress::run()
+{
+  ROS_INFO("[StepControllerStress] Running stress test for %.1f s with %u ingestion thread(s) at %.1f Hz and update rate of %.1f Hz.",
+           duration_.toSec(), ingestion_threads_, ingestion_rate_, update_rate_);
+
+  running_ = true;
+
+  boost::thread_group threads;
+  threads.create_thread(boost::bind(&StepControllerStress::spin, this));
+  for (unsigned int i = 0; i < ingestion_threads_; i++)
+    threads.create_thread(boost::bind(&StepControllerStress::ingest, this, i));
+
+  ros::WallTime end = ros::WallTime::now() + duration_;
+  while (ros::ok() && ros::WallTime::now() < end)
+    ros::WallDuration(0.1).sleep();
+
+  running_ = false;
+  threads.join_all();
+
+  // report results
+  double duration = duration_.toSec();
+  size_t requests = 0u;
+  for (size_t i = 0; i < NUM_PLAN_TYPES; i++)
+    requests += requests_[i].load();
+
+  ROS_INFO("[StepControllerStress] Requests: %lu (%.1f/s) - generated valid plans: %lu, generated invalid plans: %lu, empty plans: %lu, emergency stops: %lu, plugin reloads: %lu",
+           requests, static_cast<double>(requests) / duration, requests_[VALID_PLAN].load(), requests_[INVALID_PLAN].load(),
+           requests_[EMPTY_PLAN].load(), requests_[EMERGENCY_STOP].load(), requests_[PLUGIN_RELOAD].load());
+
+  // merge results are taken from the controller as plans may still be rejected, e.g. when racing with an emergency stop
+  size_t merged, coalesced, rejected;
+  std::vector<size_t> queue_rejects;
+  controller_->getMergeResults(merged, coalesced, rejected, queue_rejects);
+
+  size_t queue_rejected = 0u;
+  for (size_t i = 0; i < queue_rejects.size(); i++)
+    queue_rejected += queue_rejects[i];
+
+  ROS_INFO("[StepControllerStress] Merge results: merged plans: %lu, rejected by queue: %lu, rejected by queue size: %lu, coalesced plans: %lu",
+           merged, queue_rejected, rejected, coalesced);
+
+  for (size_t i = 0; i < queue_rejects.size(); i++)
+  {
+    if (queue_rejects[i] > 0u)
+      ROS_INFO("[StepControllerStress]   %s: %lu", toString(static_cast<StepQueue::RejectReason>(i)).c_str(), queue_rejects[i]);
+  }
+
+  std::sort(update_latencies_.begin(), update_latencies_.end());
+  ROS_INFO("[StepControllerStress] Update cycles: %lu (%.1f/s) - latency p50: %.3f ms, p90: %.3f ms, p99: %.3f ms, max: %.3f ms",
+           update_latencies_.size(), static_cast<double>(update_latencies_.size()) / duration,
+           getLatencyPercentile(update_latencies_, 0.5) * 1e3, getLatencyPercentile(update_latencies_, 0.9) * 1e3,
+           getLatencyPercentile(update_latencies_, 0.99) * 1e3, getLatencyPercentile(update_latencies_, 1.0) * 1e3);
+
+  size_t violations = controller_->getInvariantViolations();
+  if (violations > 0u)
+  {
+    ROS_ERROR("[StepControllerStress] Detected %lu invariant violation(s)!", violations);
+    return false;
+  }
+
+  ROS_INFO("[StepControllerStress] No invariant violations detected.");
+  return true;
+}
+
+void StepControllerStress::ingest(unsigned int thread_index)
+{
+  std::mt19937 random(seed_ + thread_index);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::uniform_int_distribution<int> length(2, plan_length_);
+  std::uniform_int_distribution<int> variant(0, 3);
+
+  boost::shared_ptr<ros::WallRate> rate;
+  if (ingestion_rate_ > 0.0)
+    rate.reset(new ros::WallRate(ingestion_rate_));
+
+  msgs::StepPlan step_plan;
+
+  while (running_)
+  {
+    double p = uniform(random);
+
+    // plugin reloads are issued by a single thread as load requests are serialized by the subscriber queue
+    if (thread_index == 0u && p < reload_ratio_)
+    {
+      controller_->reloadStepControllerPlugin(reload_plugin_);
+      requests_[PLUGIN_RELOAD]++;
+    }
+    else if (p < reload_ratio_ + emergency_stop_ratio_)
+    {
+      controller_->emergencyStop();
+      requests_[EMERGENCY_STOP]++;
+    }
+    else if (p < reload_ratio_ + emergency_stop_ratio_ + empty_plan_ratio_)
+    {
+      step_plan.steps.clear();
+      controller_->executeStepPlan(step_plan);
+      requests_[EMPTY_PLAN]++;
+    }
+    else
+    {
+      // valid plans have to overlap the current queue at its first changeable step or start a new queue
+      int min_index, max_index;
+      controller_->getValidStartIndexRange(min_index, max_index);
+      int start_index = std::uniform_int_distribution<int>(min_index, max_index)(random);
+
+      generateStepPlan(step_plan, start_index, std::max(length(random), max_index - start_index + 1), variant(random));
+
+      if (uniform(random) < invalid_plan_ratio_)
+      {
+        corruptStepPlan(step_plan, random);
+        requests_[INVALID_PLAN]++;
+      }
+      else
+        requests_[VALID_PLAN]++;
+
+      controller_->executeStepPlan(step_plan);
+    }
+
+    if (rate)
+      rate->sleep();
+  }
+}
+
+void StepControllerStress::spin()
+{
+  ros::WallRate rate(std::max(update_rate_, 1.0));
+
+  while (running_)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    controller_->update();
+
+    if (update_latencies_.size() < update_latencies_.capacity())
+      update_latencies_.push_back((ros::WallTime::now() - start).toSec());
+
+    rate.sleep();
+  }
+}
+
+void StepControllerStress::generateStepPlan(msgs::StepPlan& step_plan, int start_index, int length, int variant) const
+{
+  step_plan.header.stamp = ros::Time::now();
+  step_plan.steps.resize(static_cast<size_t>(length));
+
+  for (int i = 0; i < length; i++)
+  {
+    int step_index = start_index + i;
+
+    msgs::Step& step = step_plan.steps[static_cast<size_t>(i)];
+    step.header = step_plan.header;
+    step.step_index = step_index;
+    step.foot.header = step_plan.header;
+    step.foot.foot_index = step_index % 2 == 0 ? msgs::Foot::LEFT : msgs::Foot::RIGHT;
+    step.foot.pose.position.x = 0.2 * static_cast<double>(step_index);
+    step.foot.pose.position.y = step_index % 2 == 0 ? 0.1 : -0.1;
+    step.foot.pose.position.z = 0.0;
+    step.foot.pose.orientation.x = 0.0;
+    step.foot.pose.orientation.y = 0.0;
+    step.foot.pose.orientation.z = 0.0;
+    step.foot.pose.orientation.w = 1.0;
+    step.step_duration = 0.1;
+    step.valid = true;
+
+    // first step must match the already enqueued one
+    if (i > 0)
+      step.foot.pose.position.y += 0.01 * static_cast<double>(variant);
+  }
+}
+
+void StepControllerStress::corruptStepPlan(msgs::StepPlan& step_plan, std::mt19937& random) const
+{
+  if (step_plan.steps.size() < 2u)
+    return;
+
+  std::uniform_int_distribution<size_t> position(1u, step_plan.steps.size()-1u);
+  size_t i = position(random);
+
+  switch (random() % 3u)
+  {
+    // gap in step indices
+    case 0:
+      for (size_t j = i; j < step_plan.steps.size(); j++)
+        step_plan.steps[j].step_index++;
+      break;
+
+    // duplicate step index
+    case 1:
+      step_plan.steps[i].step_index = step_plan.steps[i-1].step_index;
+      break;
+
+    // foot index mismatch
+    default:
+      step_plan.steps.front().foot.foot_index = step_plan.steps.front().foot.foot_index == msgs::Foot::LEFT ? msgs::Foot::RIGHT : msgs::Foot::LEFT;
+      break;
+  }
+}
+
+double StepControllerStress::getLatencyPercentile(const std::vector<double>& latencies, double percentile) const
+{
+  if (latencies.empty())
+    return 0.0;
+
+  size_t index = static_cast<size_t>(std::ceil(percentile * static_cast<double>(latencies.size())));
+  return latencies[std::min(std::max(index, static_cast<size_t>(1u)), latencies.size()) - 1u];
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "vigir_step_controller_stress");
+
+  ros::NodeHandle nh;
+
+  // ensure that node's services are set up in proper namespace
+  if (nh.getNamespace().size() <= 1)
+    nh = ros::NodeHandle("~");
+
+  // init parameter and plugin manager
+  vigir_generic_params::ParameterManager::initialize(nh);
+  vigir_pluginlib::PluginManager::initialize(nh);
+
+  vigir_step_control::StepControllerStress stress(nh);
+
+  return stress.run() ? 0 : 1;
+}
@@ -5,7 +5,7 @@
 namespace vigir_step_control
 {
 StepControllerTestPlugin::StepControllerTestPlugin()
-  : StepControllerPlugin()
+  : StaticStepControllerPlugin<StepControllerTestPlugin>()
 {
 }
 
@@ -16,43 +16,50 @@ StepControllerTestPlugin::~StepControllerTestPlugin()
 void StepControllerTestPlugin::initWalk()
 {
   // init feedback states
-  msgs::ExecuteStepPlanFeedback feedback;
-  feedback.header.stamp = ros::Time::now();
-  feedback.last_performed_step_index = -2;
-  feedback.currently_executing_step_index =-1;
-  feedback.first_changeable_step_index = 0;
-  setFeedbackState(feedback);
+  updateFeedbackState([](msgs::ExecuteStepPlanFeedback& feedback)
+  {
+    feedback.header.stamp = ros::Time::now();
+    feedback.last_performed_step_index = -2;
+    feedback.currently_executing_step_index = -1;
+    feedback.first_changeable_step_index = 0;
+  });
 
   next_step_needed_time_ = ros::Time::now();
 
   setState(ACTIVE);
 
-  ROS_INFO("[StepControllerTestPlugin] Start fake execution.");
+  STEP_CONTROL_INFO("[StepControllerTestPlugin] Start fake execution.");
 }
 
 void StepControllerTestPlugin::preProcess(const ros::TimerEvent& event)
 {
   StepControllerPlugin::preProcess(event);
 
-  if (getState() != ACTIVE)
+  // fake walking engine has been halted
+  if (getState() != ACTIVE || isEmergencyStopped())
+    return;
+
+  // fake walking engine waits until the needed step has been sent
+  if (getLastStepIndexSent() < getNextStepIndexNeeded())
     return;
 
   // fake succesful execution of single step
   if (next_step_needed_time_ <= ros::Time::now())
   {
-    msgs::ExecuteStepPlanFeedback feedback = getFeedbackState();
+    int last_performed_step_index = getFeedbackState().last_performed_step_index + 1;
 
-    feedback.header.stamp = ros::Time::now();
-    feedback.last_performed_step_index++;
-
-    // check for successful execution of queue
-    if (step_queue_->lastStepIndex() == feedback.last_performed_step_index)
+    // check for successful execution of queue (streamed plans are finished after the last chunk only)
+    if (step_queue_->lastStepIndex() == last_performed_step_index && isStepPlanComplete())
     {
-      ROS_INFO("[StepControllerTestPlugin] Fake execution finished.");
+      STEP_CONTROL_INFO("[StepControllerTestPlugin] Fake execution finished.");
 
-      feedback.currently_executing_step_index = -1;
-      feedback.first_changeable_step_index = -1;
-      setFeedbackState(feedback);
+      updateFeedbackState([&](msgs::ExecuteStepPlanFeedback& feedback)
+      {
+        feedback.header.stamp = ros::Time::now();
+        feedback.last_performed_step_index = last_performed_step_index;
+        feedback.currently_executing_step_index = -1;
+        feedback.first_changeable_step_index = -1;
+      });
 
       step_queue_->reset();
       updateQueueFeedback();
@@ -62,21 +69,86 @@ void StepControllerTestPlugin::preProcess(const ros::TimerEvent& event)
     // otherwise trigger fake execution of next step
     else
     {
-      feedback.currently_executing_step_index++;
-      feedback.first_changeable_step_index++;
-      setFeedbackState(feedback);
-
-      setNextStepIndexNeeded(feedback.currently_executing_step_index);
+      int currently_executing_step_index = -1;
+
+      // in continuous walking a step which has not been enqueued yet stays changeable until it is executed
+      bool continuous_mode = isContinuousModeEnabled();
+      bool next_step_queued = step_queue_->lastStepIndex() > last_performed_step_index;
+
+      updateFeedbackState([&](msgs::ExecuteStepPlanFeedback& feedback)
+      {
+        feedback.header.stamp = ros::Time::now();
+        feedback.last_performed_step_index = last_performed_step_index;
+        feedback.currently_executing_step_index++;
+        if (continuous_mode)
+          feedback.first_changeable_step_index = feedback.currently_executing_step_index + (next_step_queued ? 1 : 0);
+        else
+          feedback.first_changeable_step_index++;
+        currently_executing_step_index = feedback.currently_executing_step_index;
+      });
+
+      setNextStepIndexNeeded(currently_executing_step_index);
+
+      // step may have been already sent ahead by the timing scheduler
+      if (getLastStepIndexSent() >= currently_executing_step_index)
+        next_step_needed_time_ = ros::Time::now() + ros::Duration(1.0 + step_queue_->getStepDuration(currently_executing_step_index, currently_executing_step_index));
     }
   }
 }
 
 bool StepControllerTestPlugin::executeStep(const msgs::Step& step)
 {
-  next_step_needed_time_ = ros::Time::now() + ros::Duration(1.0 + step.step_duration);
-  ROS_INFO("[StepControllerTestPlugin] Fake execution of step %i", step.step_index);
+  // precomputed data is available when preprocessing is enabled
+  PreprocessedStep::ConstPtr preprocessed_step = getPreprocessedStep(step);
+  if (preprocessed_step && !preprocessed_step->feasible)
+  {
+    STEP_CONTROL_ERROR("[StepControllerTestPlugin] Step %i is infeasible!", step.step_index);
+    return false;
+  }
+
+  // fake execution of step starts when it is needed (steps sent ahead are only queued)
+  if (step.step_index == getFeedbackState().currently_executing_step_index)
+  {
+    next_step_needed_time_ = ros::Time::now() + ros::Duration(1.0 + step.step_duration);
+
+    // step the walking engine has been waiting for in continuous walking is not changeable anymore
+    if (isContinuousModeEnabled() && getFeedbackState().first_changeable_step_index <= step.step_index)
+    {
+      updateFeedbackState([&](msgs::ExecuteStepPlanFeedback& feedback)
+      {
+        feedback.header.stamp = ros::Time::now();
+        feedback.first_changeable_step_index = step.step_index + 1;
+      });
+    }
+  }
+  STEP_CONTROL_INFO_THROTTLE(1.0, "[StepControllerTestPlugin] Fake execution of step %i", step.step_index);
+  return true;
+}
+
+void StepControllerTestPlugin::takeOver(StepControllerPlugin& previous)
+{
+  StepControllerPlugin::takeOver(previous);
+
+  StepControllerTestPlugin* test_plugin = dynamic_cast<StepControllerTestPlugin*>(&previous);
+  if (test_plugin)
+    next_step_needed_time_ = test_plugin->next_step_needed_time_;
+  else
+    next_step_needed_time_ = ros::Time::now();
+}
+
+bool StepControllerTestPlugin::confirmEngineState(const StepControllerSnapshot& checkpoint)
+{
+  // fake execution of current step starts over
+  next_step_needed_time_ = ros::Time::now();
+
+  STEP_CONTROL_INFO("[StepControllerTestPlugin] Continuing fake execution after step %i.", checkpoint.feedback.last_performed_step_index);
   return true;
 }
+
+void StepControllerTestPlugin::onEmergencyStop()
+{
+  STEP_CONTROL_WARN("[StepControllerTestPlugin] Emergency stop: Fake execution halted after step %i.", getLastStepIndexSent());
+}
 } // namespace
 
 #include <pluginlib/class_list_macros.h>
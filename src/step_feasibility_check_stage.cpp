@@ -0,0 +1,23 @@
+#include <vigir_step_control/step_feasibility_check_stage.h>
+
+
+
+namespace vigir_step_control
+{
+StepFeasibilityCheckStage::StepFeasibilityCheckStage()
+  : StepPreprocessingStage()
+{
+}
+
+StepFeasibilityCheckStage::~StepFeasibilityCheckStage()
+{
+}
+
+bool StepFeasibilityCheckStage::process(msgs::Step& step, boost::any& /*data*/) const
+{
+  return step.valid && !step.colliding && step.step_duration >= 0.0 && step.sway_duration >= 0.0 && step.swing_height >= 0.0;
+}
+} // namespace
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(vigir_step_control::StepFeasibilityCheckStage, vigir_step_control::StepPreprocessingStage)
@@ -0,0 +1,290 @@
+#include <vigir_step_control/step_plan_file.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+
+
+namespace vigir_step_control
+{
+static const uint32_t STEP_PLAN_FILE_MAGIC = 0x53545046; // "STPF"
+static const uint32_t STEP_PLAN_FILE_FORMAT_VERSION = 1u;
+
+template<typename Pose>
+static void encodePose(const geometry_msgs::Pose& pose, Pose& record)
+{
+  record.position[0] = pose.position.x;
+  record.position[1] = pose.position.y;
+  record.position[2] = pose.position.z;
+  record.orientation[0] = pose.orientation.x;
+  record.orientation[1] = pose.orientation.y;
+  record.orientation[2] = pose.orientation.z;
+  record.orientation[3] = pose.orientation.w;
+}
+
+template<typename Pose>
+static void decodePose(const Pose& record, geometry_msgs::Pose& pose)
+{
+  pose.position.x = record.position[0];
+  pose.position.y = record.position[1];
+  pose.position.z = record.position[2];
+  pose.orientation.x = record.orientation[0];
+  pose.orientation.y = record.orientation[1];
+  pose.orientation.z = record.orientation[2];
+  pose.orientation.w = record.orientation[3];
+}
+
+StepPlanFile::StepPlanFile(const std::string& file_name)
+  : file_name_(file_name)
+  , fd_(-1)
+  , data_(nullptr)
+  , size_(0u)
+{
+  fd_ = open(file_name_.c_str(), O_RDONLY);
+  if (fd_ < 0)
+  {
+    ROS_ERROR("[StepPlanFile] Could not open step plan file '%s'!", file_name_.c_str());
+    return;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(FileHeader))
+  {
+    ROS_ERROR("[StepPlanFile] Step plan file '%s' is too small!", file_name_.c_str());
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  size_ = static_cast<size_t>(file_stat.st_size);
+
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (data == MAP_FAILED)
+  {
+    ROS_ERROR("[StepPlanFile] Could not map step plan file '%s'!", file_name_.c_str());
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  data_ = static_cast<uint8_t*>(data);
+
+  // steps are read in order of execution
+  advise(0u, size_, MADV_SEQUENTIAL);
+
+  // only the header is checked; step records are validated by the step queue when merged
+  const FileHeader* file_header = header();
+  size_t expected_size = sizeof(FileHeader) + file_header->step_count * sizeof(StepRecord) + file_header->data_size;
+  if (file_header->magic != STEP_PLAN_FILE_MAGIC || file_header->format_version != STEP_PLAN_FILE_FORMAT_VERSION || size_ != expected_size)
+  {
+    ROS_ERROR("[StepPlanFile] '%s' is not a valid step plan file!", file_name_.c_str());
+    munmap(data_, size_);
+    data_ = nullptr;
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+StepPlanFile::~StepPlanFile()
+{
+  if (data_)
+    munmap(data_, size_);
+
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+bool StepPlanFile::write(const std::string& file_name, const msgs::StepPlan& step_plan)
+{
+  for (size_t i = 1; i < step_plan.steps.size(); i++)
+  {
+    if (step_plan.steps[i].step_index != step_plan.steps[i-1].step_index+1)
+    {
+      ROS_ERROR("[StepPlanFile] write: Step plan is not continuous (step %i follows step %i)!", step_plan.steps[i].step_index, step_plan.steps[i-1].step_index);
+      return false;
+    }
+  }
+
+  FileHeader file_header;
+  std::memset(&file_header, 0, sizeof(FileHeader));
+
+  if (step_plan.header.frame_id.size() >= sizeof(file_header.frame_id))
+  {
+    ROS_ERROR("[StepPlanFile] write: Frame id '%s' is too long!", step_plan.header.frame_id.c_str());
+    return false;
+  }
+
+  file_header.magic = STEP_PLAN_FILE_MAGIC;
+  file_header.format_version = STEP_PLAN_FILE_FORMAT_VERSION;
+  file_header.step_count = static_cast<uint32_t>(step_plan.steps.size());
+  file_header.first_step_index = step_plan.steps.empty() ? 0 : step_plan.steps.front().step_index;
+  file_header.data_size = static_cast<uint32_t>(step_plan.data.size());
+  file_header.mode = step_plan.mode;
+  file_header.start_foot_index = step_plan.start.foot_index;
+  file_header.goal_foot_index = step_plan.goal.foot_index;
+  encodePose(step_plan.start.pose, file_header.start_pose);
+  encodePose(step_plan.goal.pose, file_header.goal_pose);
+  std::strncpy(file_header.frame_id, step_plan.header.frame_id.c_str(), sizeof(file_header.frame_id) - 1);
+
+  std::ofstream file(file_name.c_str(), std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    ROS_ERROR("[StepPlanFile] write: Could not create step plan file '%s'!", file_name.c_str());
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&file_header), sizeof(FileHeader));
+
+  for (const msgs::Step& step : step_plan.steps)
+  {
+    StepRecord record;
+    std::memset(&record, 0, sizeof(StepRecord));
+    record.step_index = step.step_index;
+    record.foot_index = step.foot.foot_index;
+    record.valid = step.valid ? 1u : 0u;
+    record.colliding = step.colliding ? 1u : 0u;
+    encodePose(step.foot.pose, record.pose);
+    record.step_duration = step.step_duration;
+    record.sway_duration = step.sway_duration;
+    record.swing_height = step.swing_height;
+    record.cost = step.cost;
+    record.risk = step.risk;
+
+    file.write(reinterpret_cast<const char*>(&record), sizeof(StepRecord));
+  }
+
+  if (!step_plan.data.empty())
+    file.write(reinterpret_cast<const char*>(&step_plan.data[0]), static_cast<std::streamsize>(step_plan.data.size()));
+
+  if (!file)
+  {
+    ROS_ERROR("[StepPlanFile] write: Could not write step plan file '%s'!", file_name.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool StepPlanFile::isOpen() const
+{
+  return data_ != nullptr;
+}
+
+size_t StepPlanFile::size() const
+{
+  return isOpen() ? header()->step_count : 0u;
+}
+
+int StepPlanFile::firstStepIndex() const
+{
+  return size() > 0u ? header()->first_step_index : -1;
+}
+
+int StepPlanFile::lastStepIndex() const
+{
+  return size() > 0u ? header()->first_step_index + static_cast<int>(header()->step_count) - 1 : -1;
+}
+
+bool StepPlanFile::getStep(msgs::Step& step, int step_index) const
+{
+  if (size() == 0u || step_index < firstStepIndex() || step_index > lastStepIndex())
+    return false;
+
+  const StepRecord* r = record(step_index);
+
+  step.header.frame_id = header()->frame_id;
+  step.foot.header.frame_id = header()->frame_id;
+  step.step_index = r->step_index;
+  step.foot.foot_index = r->foot_index;
+  decodePose(r->pose, step.foot.pose);
+  step.step_duration = r->step_duration;
+  step.sway_duration = r->sway_duration;
+  step.swing_height = r->swing_height;
+  step.valid = r->valid != 0u;
+  step.colliding = r->colliding != 0u;
+  step.cost = r->cost;
+  step.risk = r->risk;
+
+  return true;
+}
+
+bool StepPlanFile::getStepPlan(msgs::StepPlan& step_plan, int from_step_index, int to_step_index) const
+{
+  if (size() == 0u || from_step_index < firstStepIndex() || from_step_index > lastStepIndex())
+    return false;
+
+  int to = std::max(std::min(to_step_index, lastStepIndex()), from_step_index - 1);
+
+  const FileHeader* file_header = header();
+
+  step_plan.header.frame_id = file_header->frame_id;
+  step_plan.header.stamp = ros::Time::now();
+  step_plan.mode = file_header->mode;
+  step_plan.start.header.frame_id = file_header->frame_id;
+  step_plan.start.foot_index = file_header->start_foot_index;
+  decodePose(file_header->start_pose, step_plan.start.pose);
+  step_plan.goal.header.frame_id = file_header->frame_id;
+  step_plan.goal.foot_index = file_header->goal_foot_index;
+  decodePose(file_header->goal_pose, step_plan.goal.pose);
+
+  if (from_step_index == firstStepIndex())
+  {
+    const uint8_t* data = data_ + sizeof(FileHeader) + file_header->step_count * sizeof(StepRecord);
+    step_plan.data.assign(data, data + file_header->data_size);
+  }
+  else
+    step_plan.data.clear();
+
+  // resize keeps memory of steps already owned by the step plan
+  step_plan.steps.resize(static_cast<size_t>(to - from_step_index + 1));
+  for (int i = from_step_index; i <= to; i++)
+    getStep(step_plan.steps[static_cast<size_t>(i - from_step_index)], i);
+
+  return true;
+}
+
+void StepPlanFile::prefetch(int from_step_index, int to_step_index) const
+{
+  if (size() == 0u)
+    return;
+
+  int from = std::max(from_step_index, firstStepIndex());
+  int to = std::min(to_step_index, lastStepIndex());
+  if (from > to)
+    return;
+
+  advise(sizeof(FileHeader) + static_cast<size_t>(from - firstStepIndex()) * sizeof(StepRecord),
+         sizeof(FileHeader) + static_cast<size_t>(to - firstStepIndex() + 1) * sizeof(StepRecord), MADV_WILLNEED);
+}
+
+void StepPlanFile::release(int step_index) const
+{
+  if (size() == 0u || step_index <= firstStepIndex())
+    return;
+
+  int to = std::min(step_index, lastStepIndex() + 1);
+
+  // the page holding the header is kept
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t end = (sizeof(FileHeader) + static_cast<size_t>(to - firstStepIndex()) * sizeof(StepRecord)) / page_size * page_size;
+  if (end > page_size)
+    advise(page_size, end, MADV_DONTNEED);
+}
+
+void StepPlanFile::advise(size_t begin, size_t end, int advice) const
+{
+  // madvise requires page aligned addresses
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  begin = begin / page_size * page_size;
+  end = std::min(end, size_);
+
+  if (begin < end)
+    madvise(data_ + begin, end - begin, advice);
+}
+} // namespace
@@ -0,0 +1,84 @@
+#include <ros/ros.h>
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include <vigir_step_control/step_plan_file.h>
+
+
+
+namespace vigir_step_control
+{
+/**
+ * @brief Extracts the last step plan found in the given bag file. Plain step plans as well as
+ * goals of the execute_step_plan action are considered.
+ * @param bag_file Path of bag file
+ * @param topic Topic to read; all topics are searched when empty
+ * @param step_plan [out] Step plan
+ * @return True if a step plan has been found
+ */
+static bool readStepPlan(const std::string& bag_file, const std::string& topic, msgs::StepPlan& step_plan)
+{
+  rosbag::Bag bag;
+
+  try
+  {
+    bag.open(bag_file, rosbag::bagmode::Read);
+  }
+  catch (rosbag::BagException& e)
+  {
+    ROS_ERROR("[StepPlanFileConverter] Could not open bag file '%s': %s", bag_file.c_str(), e.what());
+    return false;
+  }
+
+  boost::shared_ptr<rosbag::View> view(topic.empty() ? new rosbag::View(bag) : new rosbag::View(bag, rosbag::TopicQuery(topic)));
+
+  bool found = false;
+  for (const rosbag::MessageInstance& m : *view)
+  {
+    msgs::StepPlanConstPtr plan = m.instantiate<msgs::StepPlan>();
+    if (plan)
+    {
+      step_plan = *plan;
+      found = true;
+      continue;
+    }
+
+    msgs::ExecuteStepPlanActionGoalConstPtr goal = m.instantiate<msgs::ExecuteStepPlanActionGoal>();
+    if (goal)
+    {
+      step_plan = goal->goal.step_plan;
+      found = true;
+    }
+  }
+
+  bag.close();
+
+  if (!found)
+    ROS_ERROR("[StepPlanFileConverter] No step plan found in bag file '%s'!", bag_file.c_str());
+
+  return found;
+}
+}
+
+int main(int argc, char **argv)
+{
+  ros::Time::init();
+
+  if (argc < 3)
+  {
+    ROS_ERROR("Usage: step_plan_file_converter <input.bag> <output_file> [topic]");
+    return 1;
+  }
+
+  vigir_step_control::msgs::StepPlan step_plan;
+  if (!vigir_step_control::readStepPlan(argv[1], argc > 3 ? argv[3] : "", step_plan))
+    return 1;
+
+  if (!vigir_step_control::StepPlanFile::write(argv[2], step_plan))
+    return 1;
+
+  ROS_INFO("[StepPlanFileConverter] Written %lu steps to '%s'.", step_plan.steps.size(), argv[2]);
+
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include <vigir_step_control/step_preprocessor.h>
+
+#include <vigir_step_control/step_control_log.h>
+
+
+
+namespace vigir_step_control
+{
+StepPreprocessor::StepPreprocessor(const std::vector<StepPreprocessingStage::ConstPtr>& stages, unsigned int threads, unsigned int lookahead)
+  : stages_(stages)
+  , lookahead_(static_cast<int>(std::max(lookahead, 1u)))
+  , generation_(0u)
+  , window_begin_(0)
+  , window_end_(-1)
+  , last_first_step_index_(-1)
+  , last_queue_version_(0u)
+  , processed_count_(0u)
+  , num_workers_(std::max(threads, 1u))
+{
+  // workers run at default priority as results are needed in time
+  for (unsigned int i = 0; i < num_workers_; i++)
+    workers_.create_thread(boost::bind(&StepPreprocessor::run, this, i));
+}
+
+StepPreprocessor::~StepPreprocessor()
+{
+  workers_.interrupt_all();
+  workers_.join_all();
+}
+
+void StepPreprocessor::setStepQueue(StepQueue::ConstPtr step_queue)
+{
+  boost::atomic_store(&step_queue_, step_queue);
+  last_first_step_index_ = -1;
+}
+
+void StepPreprocessor::schedule(int first_step_index)
+{
+  StepQueue::ConstPtr step_queue = boost::atomic_load(&step_queue_);
+  if (!step_queue)
+    return;
+
+  // nothing has changed since last call
+  unsigned int queue_version = step_queue->version();
+  if (first_step_index == last_first_step_index_ && queue_version == last_queue_version_)
+    return;
+
+  last_first_step_index_ = first_step_index;
+  last_queue_version_ = queue_version;
+
+  int begin = std::max(first_step_index, step_queue->firstStepIndex());
+  int end = std::min(step_queue->lastStepIndex(), first_step_index + lookahead_ - 1);
+  if (begin < 0 || begin > end)
+    return;
+
+  {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    window_begin_ = begin;
+    window_end_ = end;
+    generation_++;
+  }
+
+  work_available_.notify_all();
+}
+
+PreprocessedStep::ConstPtr StepPreprocessor::process(const msgs::Step& step, size_t step_hash) const
+{
+  boost::shared_ptr<PreprocessedStep> result(new PreprocessedStep());
+  result->step_index = step.step_index;
+  result->step_hash = step_hash;
+  result->step = step;
+  result->data.resize(stages_.size());
+
+  for (size_t i = 0; i < stages_.size(); i++)
+  {
+    try
+    {
+      if (!stages_[i]->process(result->step, result->data[i]))
+      {
+        result->feasible = false;
+        break;
+      }
+    }
+    catch (std::exception& e)
+    {
+      ROS_ERROR("[StepPreprocessor] process: Stage '%s' failed on step %i: %s", stages_[i]->getName().c_str(), step.step_index, e.what());
+      result->feasible = false;
+      break;
+    }
+  }
+
+  return result;
+}
+
+size_t StepPreprocessor::getProcessedCount() const
+{
+  return processed_count_.load();
+}
+
+void StepPreprocessor::run(unsigned int worker_index)
+{
+  unsigned int generation = 0u;
+  msgs::Step step;
+
+  try
+  {
+    while (true)
+    {
+      int begin;
+      int end;
+
+      // wait for new window
+      {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (generation == generation_)
+          work_available_.wait(lock);
+
+        generation = generation_;
+        begin = window_begin_;
+        end = window_end_;
+      }
+
+      StepQueue::ConstPtr step_queue = boost::atomic_load(&step_queue_);
+      if (!step_queue)
+        continue;
+
+      // each worker processes the step indices congruent to its index
+      int num_workers = static_cast<int>(num_workers_);
+      int first_step_index = begin + (static_cast<int>(worker_index) - begin % num_workers + num_workers) % num_workers;
+      for (int step_index = first_step_index; step_index <= end; step_index += num_workers)
+      {
+        boost::this_thread::interruption_point();
+
+        // window has moved on
+        if (generation != generation_)
+          break;
+
+        // result is still valid
+        if (step_queue->getPreprocessedStep(step_index))
+          continue;
+
+        size_t step_hash;
+        if (!step_queue->getStep(step, step_hash, static_cast<unsigned int>(step_index)))
+          continue;
+
+        if (step_queue->setPreprocessedStep(process(step, step_hash)))
+          processed_count_++;
+      }
+    }
+  }
+  catch (boost::thread_interrupted&)
+  {
+  }
+}
+} // namespace
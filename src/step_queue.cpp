@@ -1,118 +1,649 @@
 #include <vigir_step_control/step_queue.h>
 
+#include <algorithm>
+#include <cmath>
+
+#include <boost/functional/hash.hpp>
+
+#include <vigir_step_control/step_control_log.h>
+
 
 
 namespace vigir_step_control
 {
+std::string toString(const StepQueue::RejectReason& reason)
+{
+  switch (reason)
+  {
+    case StepQueue::INCONSISTENT_PLAN:     return "INCONSISTENT_PLAN";
+    case StepQueue::NON_CONTINUOUS_PLAN:   return "NON_CONTINUOUS_PLAN";
+    case StepQueue::INVALID_START_INDEX:   return "INVALID_START_INDEX";
+    case StepQueue::NON_OVERLAPPING_PLAN:  return "NON_OVERLAPPING_PLAN";
+    case StepQueue::FOOT_INDEX_MISMATCH:   return "FOOT_INDEX_MISMATCH";
+    case StepQueue::CAPACITY_EXCEEDED:     return "CAPACITY_EXCEEDED";
+    default:                               return "UNKNOWN";
+  }
+}
+
 StepQueue::StepQueue()
+  : head_(0u)
+  , size_(0u)
+  , first_step_index_(0)
+  , stitched_(false)
+  , plan_complete_(true)
+  , fixed_capacity_(false)
+  , version_(0u)
+  , snapshot_enabled_(false)
 {
+  arena_capacity_ = 0u;
+  arena_size_ = 0u;
+  arena_high_water_mark_ = 0u;
+  arena_grow_count_ = 0u;
+  arena_rejected_count_ = 0u;
+
+  for (size_t i = 0; i < NUM_REJECT_REASONS; i++)
+    reject_counts_[i] = 0u;
+
+  for (size_t i = 0; i < VALIDATION_CACHE_SIZE; i++)
+    validated_plans_[i] = 0u;
+  validated_plans_next_ = 0u;
+
+  validation_hits_ = 0u;
+  validation_misses_ = 0u;
+  noop_merges_ = 0u;
+
+  corrections_.reserve(8u);
 }
 
 StepQueue::~StepQueue()
 {
 }
 
+static void hashPose(size_t& seed, const geometry_msgs::Pose& pose)
+{
+  boost::hash_combine(seed, pose.position.x);
+  boost::hash_combine(seed, pose.position.y);
+  boost::hash_combine(seed, pose.position.z);
+  boost::hash_combine(seed, pose.orientation.x);
+  boost::hash_combine(seed, pose.orientation.y);
+  boost::hash_combine(seed, pose.orientation.z);
+  boost::hash_combine(seed, pose.orientation.w);
+}
+
+static size_t hashTransform(const tf::Transform& transform)
+{
+  const tf::Vector3& t = transform.getOrigin();
+  tf::Quaternion q = transform.getRotation();
+
+  size_t seed = 0u;
+  boost::hash_combine(seed, t.x());
+  boost::hash_combine(seed, t.y());
+  boost::hash_combine(seed, t.z());
+  boost::hash_combine(seed, q.x());
+  boost::hash_combine(seed, q.y());
+  boost::hash_combine(seed, q.z());
+  boost::hash_combine(seed, q.w());
+  return seed;
+}
+
+size_t StepQueue::hashStep(const msgs::Step& step)
+{
+  size_t seed = 0u;
+  boost::hash_combine(seed, step.step_index);
+  boost::hash_combine(seed, step.foot.foot_index);
+  hashPose(seed, step.foot.pose);
+  boost::hash_combine(seed, step.step_duration);
+  boost::hash_combine(seed, step.sway_duration);
+  boost::hash_combine(seed, step.swing_height);
+  boost::hash_combine(seed, step.valid);
+  boost::hash_combine(seed, step.colliding);
+  boost::hash_combine(seed, step.cost);
+  boost::hash_combine(seed, step.risk);
+  return seed;
+}
+
+bool StepQueue::isEqual(const geometry_msgs::Pose& p1, const geometry_msgs::Pose& p2, const Tolerance& tolerance)
+{
+  double dx = p1.position.x - p2.position.x;
+  double dy = p1.position.y - p2.position.y;
+  double dz = p1.position.z - p2.position.z;
+  if (dx*dx + dy*dy + dz*dz > tolerance.position*tolerance.position)
+    return false;
+
+  const geometry_msgs::Quaternion& q1 = p1.orientation;
+  const geometry_msgs::Quaternion& q2 = p2.orientation;
+  if (q1.x == q2.x && q1.y == q2.y && q1.z == q2.z && q1.w == q2.w)
+    return true;
+
+  // rotation angle between both orientations
+  double dot = std::abs(q1.x*q2.x + q1.y*q2.y + q1.z*q2.z + q1.w*q2.w);
+  return 2.0 * std::acos(std::min(dot, 1.0)) <= tolerance.orientation;
+}
+
+bool StepQueue::isEqual(const msgs::Step& s1, const msgs::Step& s2, const Tolerance& tolerance)
+{
+  return s1.step_index == s2.step_index && s1.foot.foot_index == s2.foot.foot_index &&
+         isEqual(s1.foot.pose, s2.foot.pose, tolerance) &&
+         std::abs(s1.step_duration - s2.step_duration) <= tolerance.parameter &&
+         std::abs(s1.sway_duration - s2.sway_duration) <= tolerance.parameter &&
+         std::abs(s1.swing_height - s2.swing_height) <= tolerance.parameter;
+}
+
 void StepQueue::reset()
 {
   boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
-  step_plan_.clear();
+  head_ = 0u;
+  size_ = 0u;
+  first_step_index_ = 0;
+  stitched_ = false;
+  plan_complete_ = true;
+  corrections_.clear();
+  modified();
 }
 
-bool StepQueue::empty() const
+void StepQueue::reserve(size_t capacity, bool fixed)
+{
+  boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  fixed_capacity_ = false;
+  ensureCapacity(capacity);
+  fixed_capacity_ = fixed;
+}
+
+StepQueue::ArenaStats StepQueue::getArenaStats() const
+{
+  ArenaStats stats;
+  stats.capacity = arena_capacity_.load(boost::memory_order_relaxed);
+  stats.size = arena_size_.load(boost::memory_order_relaxed);
+  stats.high_water_mark = arena_high_water_mark_.load(boost::memory_order_relaxed);
+  stats.grow_count = arena_grow_count_.load(boost::memory_order_relaxed);
+  stats.rejected_count = arena_rejected_count_.load(boost::memory_order_relaxed);
+  return stats;
+}
+
+size_t StepQueue::getRejectCount(RejectReason reason) const
+{
+  return reason < NUM_REJECT_REASONS ? reject_counts_[reason].load() : 0u;
+}
+
+StepQueue::CacheStats StepQueue::getCacheStats() const
+{
+  CacheStats stats;
+  stats.validation_hits = validation_hits_.load(boost::memory_order_relaxed);
+  stats.validation_misses = validation_misses_.load(boost::memory_order_relaxed);
+  stats.noop_merges = noop_merges_.load(boost::memory_order_relaxed);
+  return stats;
+}
+
+void StepQueue::setMergeTolerance(const Tolerance& tolerance)
 {
   boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
-  return step_plan_.empty();
+  merge_tolerance_ = tolerance;
+}
+
+bool StepQueue::empty() const
+{
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+  return size_ == 0u;
 }
 
 size_t StepQueue::size() const
 {
   boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
-  return step_plan_.size();
+  return size_;
 }
 
-bool StepQueue::updateStepPlan(const msgs::StepPlan& step_plan, int min_step_index)
+bool StepQueue::updateStepPlan(const msgs::StepPlan& step_plan, int min_step_index, int* first_modified_step_index)
 {
   if (step_plan.steps.empty())
     return true;
 
+  boost::unique_lock<boost::mutex> cache_lock(cache_mutex_);
+
   /// check for consistency
-  msgs::ErrorStatus status = isConsistent(step_plan);
-  if (!isOk(status))
-  {
-    ROS_ERROR("[StepQueue] updateStepPlan: Consistency check failed!");
-    ROS_ERROR("%s", toString(status).c_str());
+  if (!checkStepPlan(step_plan))
     return false;
-  }
 
-  unsigned int step_plan_start_index = std::max(min_step_index, step_plan.steps.front().step_index);
+  int step_plan_start_index = std::max(min_step_index, step_plan.steps.front().step_index);
+  int step_plan_end_index = step_plan.steps.back().step_index;
 
   boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
 
-  // step index has to start at 0, when step queue is empty
-  if (this->step_plan_.empty())
+  // pose transformation needed to stitch new step plan to the queue
+  bool stitch = false;
+  tf::Transform transform;
+
+  // step index has to start at 0 or continue the removed steps, when step queue is empty
+  if (size_ == 0u)
   {
-    if (step_plan_start_index != 0)
+    if (step_plan_start_index != 0 && step_plan_start_index != first_step_index_)
+    {
+      STEP_CONTROL_ERROR("[StepQueue] updateStepPlan: Current step queue is empty. Expected step plan starting with index 0 or %i!", first_step_index_);
+      reject(INVALID_START_INDEX);
+      return false;
+    }
+    else if (step_plan_start_index > step_plan_end_index)
     {
-      ROS_ERROR("[StepQueue] updateStepPlan: Current step queue is empty. Expected step plan starting with index 0!");
+      STEP_CONTROL_ERROR("[StepQueue] updateStepPlan: Can't merge plan as it ends before the needed index (max index: %i, needed index: %i)!", step_plan_end_index, step_plan_start_index);
+      reject(NON_OVERLAPPING_PLAN);
       return false;
     }
   }
   else
   {
-    msgs::Step old_step;
-    msgs::Step new_step;
-
     // check if queue and given step plan has overlapping steps
-    if (!this->step_plan_.getStep(old_step, step_plan_start_index))
+    if (!hasStep(step_plan_start_index))
     {
-      ROS_ERROR("[StepQueue] updateStepPlan: Can't merge plan due to non-overlapping step indices of current step plan (max queued index: %i, needed index: %u)!", this->step_plan_.getLastStepIndex(), step_plan_start_index);
+      STEP_CONTROL_ERROR("[StepQueue] updateStepPlan: Can't merge plan due to non-overlapping step indices of current step plan (max queued index: %i, needed index: %i)!", first_step_index_ + static_cast<int>(size_) - 1, step_plan_start_index);
+      reject(NON_OVERLAPPING_PLAN);
       return false;
     }
     // check if input step plan has needed overlapping steps
-    else if (!StepPlan::getStep(new_step, step_plan, step_plan_start_index))
+    else if (step_plan_start_index > step_plan_end_index)
     {
-      ROS_ERROR("[StepQueue] updateStepPlan: Can't merge plan due to non-overlapping step indices of new step plan (max index: %u, needed index: %u)!", step_plan.steps.back().step_index, step_plan_start_index);
+      STEP_CONTROL_ERROR("[StepQueue] updateStepPlan: Can't merge plan due to non-overlapping step indices of new step plan (max index: %i, needed index: %i)!", step_plan_end_index, step_plan_start_index);
+      reject(NON_OVERLAPPING_PLAN);
       return false;
     }
+
+    const msgs::Step& old_step = slot(step_plan_start_index);
+    const msgs::Step& new_step = step_plan.steps[step_plan_start_index - step_plan.steps.front().step_index];
+
     // check if overlapping indeces have the same foot index
-    else if (old_step.foot.foot_index != new_step.foot.foot_index)
+    if (old_step.foot.foot_index != new_step.foot.foot_index)
     {
-      ROS_ERROR("[StepQueue] updateStepPlan: Step %u has wrong foot index!", step_plan_start_index);
+      STEP_CONTROL_ERROR("[StepQueue] updateStepPlan: Step %i has wrong foot index!", step_plan_start_index);
+      reject(FOOT_INDEX_MISMATCH);
       return false;
     }
     // check if start foot position is equal
     else
     {
-      geometry_msgs::Pose p_old = old_step.foot.pose;
-      geometry_msgs::Pose p_new = new_step.foot.pose;
+      const geometry_msgs::Pose& p_old = old_step.foot.pose;
+      const geometry_msgs::Pose& p_new = new_step.foot.pose;
       if (p_old.position.x != p_new.position.x || p_old.position.y != p_new.position.y || p_old.position.z != p_new.position.z)
       {
-        ROS_WARN("[StepQueue] updateStepPlan: Overlapping step differs in position!");
+        STEP_CONTROL_WARN_THROTTLE(1.0, "[StepQueue] updateStepPlan: Overlapping step differs in position!");
+        stitch = true;
       }
       if (p_old.orientation.x != p_new.orientation.x || p_old.orientation.y != p_new.orientation.y || p_old.orientation.z != p_new.orientation.z || p_old.orientation.w != p_new.orientation.w)
       {
-        ROS_WARN("[StepQueue] updateStepPlan: Overlapping step differs in orientation!");
+        STEP_CONTROL_WARN_THROTTLE(1.0, "[StepQueue] updateStepPlan: Overlapping step differs in orientation!");
+        stitch = true;
+      }
+
+      // new step plan has to be transformed into the frame of the queued steps
+      if (stitch)
+      {
+        tf::Pose old_pose;
+        tf::Pose new_pose;
+        tf::poseMsgToTF(p_old, old_pose);
+        tf::poseMsgToTF(p_new, new_pose);
+        transform = old_pose * new_pose.inverse();
       }
     }
   }
 
+  // queue has to hold all steps in [first_step_index_; step_plan_end_index]
+  size_t new_size = size_ == 0u ? static_cast<size_t>(step_plan_end_index - step_plan_start_index + 1) : static_cast<size_t>(step_plan_end_index - first_step_index_ + 1);
+  if (!ensureCapacity(new_size))
+  {
+    STEP_CONTROL_ERROR("[StepQueue] updateStepPlan: Can't merge plan as resulting queue size (%lu) exceeds fixed capacity (%lu)!", new_size, slots_.size());
+    arena_rejected_count_.fetch_add(1u, boost::memory_order_relaxed);
+    reject(CAPACITY_EXCEEDED);
+    return false;
+  }
+
   /// merge step plan
-  status += this->step_plan_.stitchStepPlan(step_plan, step_plan_start_index);
-  this->step_plan_.removeSteps(step_plan.steps.rbegin()->step_index+1);
+  int last_queued_step_index = size_ == 0u ? step_plan_start_index - 1 : first_step_index_ + static_cast<int>(size_) - 1;
+
+  // without any modified steps, the first appended or removed step marks the change
+  int first_modified = std::min(last_queued_step_index, step_plan_end_index) + 1;
+
+  bool changed = new_size != size_;
+
+  if (size_ == 0u)
+  {
+    head_ = 0u;
+    first_step_index_ = step_plan_start_index;
+  }
+
+  size_ = new_size;
+
+  stitched_ = stitch;
+  if (stitch)
+    stitch_transform_ = transform;
+
+  size_t transform_hash = stitch ? hashTransform(transform) : 0u;
+
+  for (size_t i = 0; i < step_plan.steps.size(); i++)
+  {
+    const msgs::Step& step = step_plan.steps[i];
+    if (step.step_index < step_plan_start_index)
+      continue;
+
+    size_t hash = plan_step_hashes_[i];
+    boost::hash_combine(hash, transform_hash);
+
+    // same source step has been already merged in the same way
+    if (step.step_index <= last_queued_step_index && slotHash(step.step_index) == hash)
+      continue;
+
+    // copy assignment reuses memory already owned by the buffer
+    merge_buffer_ = step;
+
+    if (stitch)
+    {
+      tf::Pose pose;
+      tf::poseMsgToTF(merge_buffer_.foot.pose, pose);
+      tf::poseTFToMsg(transform * pose, merge_buffer_.foot.pose);
+    }
+
+    msgs::Step& queued_step = slot(step.step_index);
+
+    // slots beyond the previous queue end contain recycled steps only
+    if (step.step_index < first_modified)
+    {
+      // step within tolerance is kept as queued, as it may have been already sent and won't be sent again
+      if (isEqual(queued_step, merge_buffer_, merge_tolerance_))
+        continue;
+
+      first_modified = step.step_index;
+    }
+
+    // swap keeps memory of both steps for reuse
+    std::swap(queued_step, merge_buffer_);
+    slotHash(step.step_index) = hash;
+    changed = true;
+  }
+
+  if (first_modified_step_index)
+    *first_modified_step_index = first_modified;
 
-  return isOk(status);
+  // steps below the stitching point keep their timeline
+  if (changed)
+    updateTimeline(std::min(first_modified, step_plan_start_index));
+
+  // resubmitted step plan does not change anything
+  if (!changed)
+  {
+    noop_merges_.fetch_add(1u, boost::memory_order_relaxed);
+    return true;
+  }
+
+  updateArenaSize();
+
+  modified();
+
+  return true;
+}
+
+bool StepQueue::extendStepPlan(const msgs::StepPlan& step_plan)
+{
+  if (step_plan.steps.empty())
+    return true;
+
+  boost::unique_lock<boost::mutex> cache_lock(cache_mutex_);
+
+  /// check for consistency
+  if (!checkStepPlan(step_plan))
+    return false;
+
+  boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  // steps have to be appended without gap
+  int next_step_index = first_step_index_ + static_cast<int>(size_);
+  if (step_plan.steps.front().step_index != next_step_index)
+  {
+    STEP_CONTROL_ERROR("[StepQueue] extendStepPlan: Can't extend queue with step %i (expected index: %i)!", step_plan.steps.front().step_index, next_step_index);
+    reject(INVALID_START_INDEX);
+    return false;
+  }
+
+  if (!ensureCapacity(size_ + step_plan.steps.size()))
+  {
+    STEP_CONTROL_ERROR("[StepQueue] extendStepPlan: Can't extend queue as resulting queue size (%lu) exceeds fixed capacity (%lu)!", size_ + step_plan.steps.size(), slots_.size());
+    arena_rejected_count_.fetch_add(1u, boost::memory_order_relaxed);
+    reject(CAPACITY_EXCEEDED);
+    return false;
+  }
+
+  size_ += step_plan.steps.size();
+
+  size_t transform_hash = stitched_ ? hashTransform(stitch_transform_) : 0u;
+
+  for (size_t i = 0; i < step_plan.steps.size(); i++)
+  {
+    const msgs::Step& step = step_plan.steps[i];
+
+    msgs::Step& queued_step = slot(step.step_index);
+    queued_step = step;
+
+    size_t& hash = slotHash(step.step_index);
+    hash = plan_step_hashes_[i];
+    boost::hash_combine(hash, transform_hash);
+
+    // apply same transformation as used for stitching the beginning of the plan
+    if (stitched_)
+    {
+      tf::Pose pose;
+      tf::poseMsgToTF(queued_step.foot.pose, pose);
+      tf::poseTFToMsg(stitch_transform_ * pose, queued_step.foot.pose);
+    }
+  }
+
+  updateTimeline(step_plan.steps.front().step_index);
+
+  updateArenaSize();
+
+  modified();
+
+  return true;
+}
+
+bool StepQueue::restore(const std::vector<msgs::Step>& steps, bool plan_complete)
+{
+  if (steps.empty())
+    return false;
+
+  for (size_t i = 1; i < steps.size(); i++)
+  {
+    if (steps[i].step_index != steps[i-1].step_index+1)
+    {
+      STEP_CONTROL_ERROR("[StepQueue] restore: Steps are not continuous (step %i follows step %i)!", steps[i].step_index, steps[i-1].step_index);
+      return false;
+    }
+  }
+
+  boost::unique_lock<boost::mutex> cache_lock(cache_mutex_);
+  boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (!ensureCapacity(steps.size()))
+  {
+    STEP_CONTROL_ERROR("[StepQueue] restore: Can't restore queue as its size (%lu) exceeds fixed capacity (%lu)!", steps.size(), slots_.size());
+    reject(CAPACITY_EXCEEDED);
+    return false;
+  }
+
+  head_ = 0u;
+  size_ = steps.size();
+  first_step_index_ = steps.front().step_index;
+  stitched_ = false;
+  plan_complete_ = plan_complete;
+
+  // snapshots contain already corrected steps
+  corrections_.clear();
+
+  for (size_t i = 0; i < steps.size(); i++)
+  {
+    slots_[i] = steps[i];
+
+    // restored steps are treated like unstitched merges
+    slot_hashes_[i] = hashStep(steps[i]);
+    boost::hash_combine(slot_hashes_[i], static_cast<size_t>(0u));
+  }
+
+  updateTimeline(first_step_index_);
+
+  updateArenaSize();
+
+  modified();
+
+  return true;
 }
 
-bool StepQueue::getStep(msgs::Step& step, unsigned int step_index)
+bool StepQueue::rebase(int offset)
+{
+  boost::unique_lock<boost::mutex> cache_lock(cache_mutex_);
+  boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (offset <= 0 || (size_ > 0u && first_step_index_ < offset))
+  {
+    STEP_CONTROL_ERROR("[StepQueue] rebase: Can't rebase queue starting at step %i by offset %i!", first_step_index_, offset);
+    return false;
+  }
+
+  first_step_index_ -= offset;
+
+  for (Correction& correction : corrections_)
+    correction.from_step_index -= offset;
+
+  for (int i = first_step_index_; i < first_step_index_ + static_cast<int>(size_); i++)
+  {
+    msgs::Step& step = slot(i);
+    step.step_index = i;
+
+    // the original step is not available anymore, so rebased steps are treated like unstitched merges
+    size_t& hash = slotHash(i);
+    hash = hashStep(step);
+    boost::hash_combine(hash, static_cast<size_t>(0u));
+
+    // preprocessing results are bound to the previous step index
+    slotResult(i).reset();
+  }
+
+  modified();
+
+  return true;
+}
+
+void StepQueue::applyCorrection(const tf::Transform& correction, int from_step_index)
+{
+  boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  // drop corrections superseded before the queue start
+  size_t obsolete = 0u;
+  while (obsolete+1 < corrections_.size() && corrections_[obsolete+1].from_step_index <= first_step_index_)
+    obsolete++;
+  corrections_.erase(corrections_.begin(), corrections_.begin() + static_cast<long>(obsolete));
+
+  // find first correction affected
+  size_t i = 0u;
+  while (i < corrections_.size() && corrections_[i].from_step_index < from_step_index)
+    i++;
+
+  // new boundary starts with the correction accumulated so far
+  if (i == corrections_.size() || corrections_[i].from_step_index != from_step_index)
+  {
+    Correction boundary;
+    boundary.from_step_index = from_step_index;
+    boundary.transform = i > 0u ? corrections_[i-1].transform : tf::Transform::getIdentity();
+    corrections_.insert(corrections_.begin() + static_cast<long>(i), boundary);
+  }
+
+  for (; i < corrections_.size(); i++)
+  {
+    corrections_[i].transform = correction * corrections_[i].transform;
+    corrections_[i].hash = hashTransform(corrections_[i].transform);
+  }
+
+  modified();
+}
+
+void StepQueue::setPlanComplete(bool complete)
+{
+  boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (plan_complete_ == complete)
+    return;
+
+  plan_complete_ = complete;
+  modified();
+}
+
+bool StepQueue::isPlanComplete() const
+{
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+  return plan_complete_;
+}
+
+bool StepQueue::getStep(msgs::Step& step, unsigned int step_index) const
 {
   boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
-  return step_plan_.getStep(step, step_index);
+
+  if (!hasStep(static_cast<int>(step_index)))
+    return false;
+
+  step = slot(static_cast<int>(step_index));
+  correctStep(step);
+  return true;
 }
 
-bool StepQueue::getStepAt(msgs::Step& step, unsigned int position)
+bool StepQueue::getStep(msgs::Step& step, size_t& step_hash, unsigned int step_index) const
 {
   boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
-  return step_plan_.getStepAt(step, position);
+
+  if (!hasStep(static_cast<int>(step_index)))
+    return false;
+
+  step = slot(static_cast<int>(step_index));
+  correctStep(step);
+  step_hash = correctedSlotHash(static_cast<int>(step_index));
+  return true;
+}
+
+PreprocessedStep::ConstPtr StepQueue::getPreprocessedStep(int step_index) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (!hasStep(step_index))
+    return PreprocessedStep::ConstPtr();
+
+  const PreprocessedStep::ConstPtr& result = slotResult(step_index);
+  if (!result || result->step_index != step_index || result->step_hash != correctedSlotHash(step_index))
+    return PreprocessedStep::ConstPtr();
+
+  return result;
+}
+
+bool StepQueue::setPreprocessedStep(PreprocessedStep::ConstPtr result) const
+{
+  if (!result)
+    return false;
+
+  {
+    boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
+
+    if (!hasStep(result->step_index) || correctedSlotHash(result->step_index) != result->step_hash)
+      return false;
+
+    // previous result is released after unlocking
+    slotResult(result->step_index).swap(result);
+  }
+
+  return true;
+}
+
+bool StepQueue::getStepAt(msgs::Step& step, unsigned int position) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (position >= size_)
+    return false;
+
+  step = slots_[(head_ + position) % slots_.size()];
+  correctStep(step);
+  return true;
 }
 
 std::vector<msgs::Step> StepQueue::getSteps(unsigned int start_index, unsigned int end_index) const
@@ -123,30 +654,134 @@ std::vector<msgs::Step> StepQueue::getSteps(unsigned int start_index, unsigned i
 
   for (unsigned int i = start_index; i <= end_index; i++)
   {
-    msgs::Step step;
-    if (step_plan_.getStep(step, i))
-      steps.push_back(step);
+    if (hasStep(static_cast<int>(i)))
+    {
+      steps.push_back(slot(static_cast<int>(i)));
+      correctStep(steps.back());
+    }
   }
 
   return steps;
 }
 
+double StepQueue::getStepDuration(int from_step_index, int to_step_index) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (size_ == 0u)
+    return 0.0;
+
+  int from = std::max(from_step_index, first_step_index_);
+  int to = std::min(to_step_index, first_step_index_ + static_cast<int>(size_) - 1);
+
+  if (from > to)
+    return 0.0;
+
+  return slotEndTime(to) - slotStartTime(from);
+}
+
+int StepQueue::getStepIndexAt(int from_step_index, double elapsed) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (!hasStep(from_step_index))
+    return -1;
+
+  double time = slotStartTime(from_step_index) + std::max(elapsed, 0.0);
+
+  // binary search for first step finishing after given time; end times are monotonic in step order
+  int low = from_step_index;
+  int high = first_step_index_ + static_cast<int>(size_);
+  while (low < high)
+  {
+    int mid = low + (high - low) / 2;
+    if (slotEndTime(mid) <= time)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return hasStep(low) ? low : -1;
+}
+
+bool StepQueue::getStepFinishTimes(int from_step_index, std::vector<double>& finish_times) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  finish_times.clear();
+
+  if (!hasStep(from_step_index))
+    return false;
+
+  double start = slotStartTime(from_step_index);
+  for (int i = from_step_index; hasStep(i); i++)
+    finish_times.push_back(slotEndTime(i) - start);
+
+  return true;
+}
+
 void StepQueue::removeStep(unsigned int step_index)
 {
-  boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
-  step_plan_.removeStep(step_index);
+  removeSteps(step_index, static_cast<int>(step_index));
 }
 
 void StepQueue::removeSteps(unsigned int from_step_index, int to_step_index)
 {
   boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
-  step_plan_.removeSteps(from_step_index, to_step_index);
+
+  if (size_ == 0u)
+    return;
+
+  int first_step_index = first_step_index_;
+  int last_step_index = first_step_index_ + static_cast<int>(size_) - 1;
+  int from = static_cast<int>(from_step_index);
+  int to = to_step_index < 0 ? last_step_index : to_step_index;
+
+  // nothing to remove
+  if (from > to || from > last_step_index || to < first_step_index)
+    return;
+
+  // remove from front; slots are recycled
+  if (from <= first_step_index)
+  {
+    size_t count = static_cast<size_t>(std::min(to, last_step_index) - first_step_index + 1);
+    head_ = (head_ + count) % slots_.size();
+    size_ -= count;
+    first_step_index_ += static_cast<int>(count);
+  }
+  // remove from back
+  else if (to >= last_step_index)
+  {
+    size_ = static_cast<size_t>(from - first_step_index);
+  }
+  else
+  {
+    STEP_CONTROL_WARN("[StepQueue] removeSteps: Can't remove steps [%i; %i] as it would leave a gap in queue [%i; %i]!", from, to, first_step_index, last_step_index);
+    return;
+  }
+
+  updateArenaSize();
+
+  modified();
 }
 
 bool StepQueue::popStep(msgs::Step& step)
 {
   boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
-  return step_plan_.popStep(step);
+
+  if (size_ == 0u)
+    return false;
+
+  step = slots_[head_];
+  correctStep(step);
+
+  head_ = (head_ + 1) % slots_.size();
+  size_--;
+  first_step_index_++;
+  updateArenaSize();
+
+  modified();
+  return true;
 }
 
 bool StepQueue::popStep()
@@ -158,22 +793,212 @@ bool StepQueue::popStep()
 int StepQueue::firstStepIndex() const
 {
   boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
-
-  msgs::Step step;
-  if (step_plan_.getfirstStep(step))
-    return step.step_index;
-  else
-    return -1;
+  return size_ > 0u ? first_step_index_ : -1;
 }
 
 int StepQueue::lastStepIndex() const
 {
   boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+  return size_ > 0u ? first_step_index_ + static_cast<int>(size_) - 1 : -1;
+}
 
-  msgs::Step step;
-  if (step_plan_.getLastStep(step))
-    return step.step_index;
-  else
-    return -1;
+bool StepQueue::checkIntegrity() const
+{
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (size_ > slots_.size() || (size_ > 0u && first_step_index_ < 0))
+    return false;
+
+  for (int i = 0; i < static_cast<int>(size_); i++)
+  {
+    if (slot(first_step_index_ + i).step_index != first_step_index_ + i)
+      return false;
+  }
+
+  return true;
+}
+
+unsigned int StepQueue::version() const
+{
+  return version_.load();
+}
+
+void StepQueue::setSnapshotEnabled(bool enable)
+{
+  boost::unique_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  snapshot_enabled_ = enable;
+
+  if (!snapshot_enabled_)
+    boost::atomic_store(&snapshot_, Snapshot::ConstPtr());
+}
+
+StepQueue::Snapshot::ConstPtr StepQueue::getSnapshot() const
+{
+  // queue has not been modified since the last snapshot was taken
+  Snapshot::ConstPtr snapshot = boost::atomic_load(&snapshot_);
+  if (snapshot && snapshot->version == version_.load())
+    return snapshot;
+
+  boost::shared_lock<boost::shared_mutex> lock(queue_mutex_);
+
+  if (!snapshot_enabled_)
+    return Snapshot::ConstPtr();
+
+  // another reader may have already taken the snapshot meanwhile
+  snapshot = boost::atomic_load(&snapshot_);
+  unsigned int version = version_.load();
+  if (snapshot && snapshot->version == version)
+    return snapshot;
+
+  boost::shared_ptr<Snapshot> new_snapshot(new Snapshot());
+  new_snapshot->version = version;
+  new_snapshot->plan_complete = plan_complete_;
+  new_snapshot->steps.reserve(size_);
+  for (size_t i = 0; i < size_; i++)
+  {
+    new_snapshot->steps.push_back(slots_[(head_ + i) % slots_.size()]);
+    correctStep(new_snapshot->steps.back());
+  }
+
+  snapshot = new_snapshot;
+  boost::atomic_store(&snapshot_, snapshot);
+  return snapshot;
+}
+
+void StepQueue::modified()
+{
+  // snapshots are taken lazily by the reading thread (see getSnapshot())
+  version_++;
+}
+
+void StepQueue::updateArenaSize()
+{
+  // only written while holding the queue lock, so no compare-exchange is needed
+  arena_size_.store(size_, boost::memory_order_relaxed);
+  if (size_ > arena_high_water_mark_.load(boost::memory_order_relaxed))
+    arena_high_water_mark_.store(size_, boost::memory_order_relaxed);
+}
+
+void StepQueue::updateTimeline(int from_step_index)
+{
+  int from = std::max(from_step_index, first_step_index_);
+  int last = first_step_index_ + static_cast<int>(size_) - 1;
+
+  double time = from > first_step_index_ ? slotEndTime(from-1) : 0.0;
+  for (int i = from; i <= last; i++)
+  {
+    time += slot(i).step_duration;
+    slotEndTime(i) = time;
+  }
+}
+
+void StepQueue::correctStep(msgs::Step& step) const
+{
+  const Correction* correction = getCorrection(step.step_index);
+  if (!correction)
+    return;
+
+  tf::Pose pose;
+  tf::poseMsgToTF(step.foot.pose, pose);
+  tf::poseTFToMsg(correction->transform * pose, step.foot.pose);
+}
+
+size_t StepQueue::correctedSlotHash(int step_index) const
+{
+  size_t hash = slotHash(step_index);
+
+  const Correction* correction = getCorrection(step_index);
+  if (correction)
+    boost::hash_combine(hash, correction->hash);
+
+  return hash;
+}
+
+bool StepQueue::checkStepPlan(const msgs::StepPlan& step_plan)
+{
+  // hash plan content; step hashes are kept for merging
+  size_t plan_hash = 0u;
+  boost::hash_combine(plan_hash, step_plan.header.frame_id);
+  boost::hash_combine(plan_hash, step_plan.mode);
+  boost::hash_combine(plan_hash, step_plan.start.foot_index);
+  hashPose(plan_hash, step_plan.start.pose);
+  boost::hash_combine(plan_hash, step_plan.goal.foot_index);
+  hashPose(plan_hash, step_plan.goal.pose);
+  boost::hash_range(plan_hash, step_plan.data.begin(), step_plan.data.end());
+
+  plan_step_hashes_.resize(step_plan.steps.size());
+  for (size_t i = 0; i < step_plan.steps.size(); i++)
+  {
+    plan_step_hashes_[i] = hashStep(step_plan.steps[i]);
+    boost::hash_combine(plan_hash, plan_step_hashes_[i]);
+  }
+
+  // same step plan has been validated recently
+  if (std::find(validated_plans_, validated_plans_ + VALIDATION_CACHE_SIZE, plan_hash) != validated_plans_ + VALIDATION_CACHE_SIZE)
+  {
+    validation_hits_.fetch_add(1u, boost::memory_order_relaxed);
+    return true;
+  }
+
+  validation_misses_.fetch_add(1u, boost::memory_order_relaxed);
+
+  msgs::ErrorStatus status = isConsistent(step_plan);
+  if (!isOk(status))
+  {
+    STEP_CONTROL_ERROR("[StepQueue] checkStepPlan: Consistency check failed (error: %u, warning: %u)!", status.error, status.warning);
+    reject(INCONSISTENT_PLAN);
+    return false;
+  }
+
+  // the queue must not contain any gaps
+  for (size_t i = 1; i < step_plan.steps.size(); i++)
+  {
+    if (step_plan.steps[i].step_index != step_plan.steps[i-1].step_index+1)
+    {
+      STEP_CONTROL_ERROR("[StepQueue] Step plan is not continuous (step %i follows step %i)!", step_plan.steps[i].step_index, step_plan.steps[i-1].step_index);
+      reject(NON_CONTINUOUS_PLAN);
+      return false;
+    }
+  }
+
+  validated_plans_[validated_plans_next_] = plan_hash;
+  validated_plans_next_ = (validated_plans_next_ + 1) % VALIDATION_CACHE_SIZE;
+
+  return true;
+}
+
+bool StepQueue::ensureCapacity(size_t size)
+{
+  if (size <= slots_.size())
+    return true;
+
+  if (fixed_capacity_)
+    return false;
+
+  // enlarge arena while keeping logical order of queued steps
+  size_t capacity = std::max(size, 2 * slots_.size());
+  std::vector<msgs::Step> slots(capacity);
+  std::vector<size_t> slot_hashes(capacity, 0u);
+  std::vector<double> slot_end_times(capacity, 0.0);
+  std::vector<PreprocessedStep::ConstPtr> slot_results(capacity);
+  for (size_t i = 0; i < size_; i++)
+  {
+    std::swap(slots[i], slots_[(head_ + i) % slots_.size()]);
+    slot_hashes[i] = slot_hashes_[(head_ + i) % slot_hashes_.size()];
+    slot_end_times[i] = slot_end_times_[(head_ + i) % slot_end_times_.size()];
+    slot_results[i].swap(slot_results_[(head_ + i) % slot_results_.size()]);
+  }
+
+  slots_.swap(slots);
+  slot_hashes_.swap(slot_hashes);
+  slot_end_times_.swap(slot_end_times);
+  slot_results_.swap(slot_results);
+  head_ = 0u;
+
+  arena_capacity_.store(capacity, boost::memory_order_relaxed);
+  arena_grow_count_.fetch_add(1u, boost::memory_order_relaxed);
+
+  return true;
 }
 } // namespace
@@ -0,0 +1,125 @@
+#include <vigir_step_control/step_queue_introspection.h>
+
+#include <vigir_step_control/thread_utils.h>
+
+
+
+namespace vigir_step_control
+{
+StepQueueIntrospection::StepQueueIntrospection(ros::NodeHandle& nh, SnapshotCallback get_snapshot, double rate, double full_state_period)
+  : get_snapshot_(get_snapshot)
+  , period_(1.0/rate)
+  , full_state_period_(full_state_period)
+{
+  step_queue_delta_pub_ = nh.advertise<StepQueueDelta>("step_queue", 10);
+
+  thread_ = boost::thread(&StepQueueIntrospection::run, this);
+
+  // introspection must never compete with the control loop
+  setThreadPriority(thread_, -1);
+}
+
+StepQueueIntrospection::~StepQueueIntrospection()
+{
+  thread_.interrupt();
+  thread_.join();
+}
+
+void StepQueueIntrospection::run()
+{
+  ros::WallTime last_full_state;
+  uint32_t last_num_subscribers = 0u;
+
+  try
+  {
+    while (ros::ok())
+    {
+      boost::this_thread::sleep(boost::posix_time::microseconds(period_.toNSec() / 1000));
+
+      StepControllerSnapshot::ConstPtr snapshot = get_snapshot_();
+      if (!snapshot)
+        continue;
+
+      // send full state to new subscribers immediately and periodically to late ones, even if nothing has changed
+      ros::WallTime now = ros::WallTime::now();
+      uint32_t num_subscribers = step_queue_delta_pub_.getNumSubscribers();
+      bool full_state = !last_snapshot_ || num_subscribers > last_num_subscribers || (now - last_full_state) >= full_state_period_;
+      last_num_subscribers = num_subscribers;
+
+      // nothing has changed since last cycle
+      if (snapshot == last_snapshot_ && !full_state)
+        continue;
+
+      if (full_state)
+        last_full_state = now;
+
+      if (num_subscribers > 0)
+      {
+        StepQueueDelta msg;
+        generateDelta(*snapshot, full_state, msg);
+        step_queue_delta_pub_.publish(msg);
+      }
+
+      last_snapshot_ = snapshot;
+    }
+  }
+  catch (boost::thread_interrupted&)
+  {
+  }
+}
+
+void StepQueueIntrospection::generateDelta(const StepControllerSnapshot& snapshot, bool full_state, StepQueueDelta& msg) const
+{
+  msg.header.stamp = ros::Time::now();
+  msg.full_state = full_state;
+
+  msg.controller_state = snapshot.state;
+  msg.next_step_index_needed = snapshot.next_step_index_needed;
+  msg.last_step_index_sent = snapshot.last_step_index_sent;
+  msg.last_performed_step_index = snapshot.feedback.last_performed_step_index;
+  msg.currently_executing_step_index = snapshot.feedback.currently_executing_step_index;
+  msg.first_changeable_step_index = snapshot.feedback.first_changeable_step_index;
+  msg.replan_invalidated_steps = snapshot.replan_invalidated_steps;
+
+  if (!snapshot.queue)
+    return;
+
+  const std::vector<msgs::Step>& steps = snapshot.queue->steps;
+
+  if (full_state || !last_snapshot_ || !last_snapshot_->queue)
+  {
+    msg.full_state = true;
+    msg.updated_steps = steps;
+    return;
+  }
+
+  if (last_snapshot_->queue == snapshot.queue)
+    return;
+
+  const std::vector<msgs::Step>& last_steps = last_snapshot_->queue->steps;
+
+  // both lists are ordered by step index, so they can be merged in a single pass
+  std::vector<msgs::Step>::const_iterator itr = steps.begin();
+  std::vector<msgs::Step>::const_iterator last_itr = last_steps.begin();
+  while (itr != steps.end() || last_itr != last_steps.end())
+  {
+    if (itr == steps.end() || (last_itr != last_steps.end() && last_itr->step_index < itr->step_index))
+    {
+      msg.removed_step_indices.push_back(last_itr->step_index);
+      last_itr++;
+    }
+    else if (last_itr == last_steps.end() || itr->step_index < last_itr->step_index)
+    {
+      msg.updated_steps.push_back(*itr);
+      itr++;
+    }
+    else
+    {
+      if (!StepQueue::isEqual(*itr, *last_itr))
+        msg.updated_steps.push_back(*itr);
+      itr++;
+      last_itr++;
+    }
+  }
+}
+} // namespace
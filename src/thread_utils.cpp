@@ -0,0 +1,45 @@
+#include <vigir_step_control/thread_utils.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <ros/ros.h>
+
+
+
+namespace vigir_step_control
+{
+bool setThreadPriority(boost::thread& thread, int priority)
+{
+  sched_param param;
+  int policy;
+
+  if (priority > 0)
+  {
+    policy = SCHED_FIFO;
+    param.sched_priority = std::min(priority, sched_get_priority_max(SCHED_FIFO));
+  }
+  else if (priority == 0)
+  {
+    policy = SCHED_OTHER;
+    param.sched_priority = 0;
+  }
+  else
+  {
+    policy = SCHED_IDLE;
+    param.sched_priority = 0;
+  }
+
+  int result = pthread_setschedparam(thread.native_handle(), policy, &param);
+  if (result != 0)
+  {
+    ROS_WARN("[setThreadPriority] Could not set priority %i: %s", priority, strerror(result));
+    return false;
+  }
+
+  return true;
+}
+} // namespace